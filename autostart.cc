@@ -0,0 +1,162 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
+#include <map>
+#include "autostart.h"
+
+static std::string Trim(const std::string &str)
+{
+    size_t start = str.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+        return "";
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(start, end - start + 1);
+}
+
+/// @brief Check if a program can be found and run.
+static bool Executable(const std::string &program)
+{
+    if (program.find('/') != std::string::npos)
+        return access(program.c_str(), X_OK) == 0;
+    const char *path = getenv("PATH");
+    std::string dirs = path ? path : "";
+    size_t pos = 0;
+    while (pos <= dirs.size())
+    {
+        size_t end = dirs.find(':', pos);
+        if (end == std::string::npos)
+            end = dirs.size();
+        std::string dir = dirs.substr(pos, end - pos);
+        if (!dir.empty() && access((dir + "/" + program).c_str(), X_OK) == 0)
+            return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+/// @brief Remove field codes from an Exec value, as there are no files or
+/// URLs to pass.
+static std::string StripFieldCodes(const std::string &exec)
+{
+    std::string ret;
+    for (size_t i = 0; i < exec.size(); i++)
+    {
+        if (exec[i] != '%')
+            ret += exec[i];
+        else if (i + 1 < exec.size() && exec[++i] == '%')
+            ret += '%';
+    }
+    return Trim(ret);
+}
+
+/// @brief Read the command of a desktop entry file.
+/// @return false if the entry should not be started.
+static bool ReadEntry(const std::string &path, std::string &program)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == NULL)
+        return false;
+
+    std::map<std::string, std::string> keys;
+    bool inentry = false;
+    char line[4096];
+    while (fgets(line, sizeof(line), f))
+    {
+        std::string str = Trim(line);
+        if (str.empty() || str[0] == '#')
+            continue;
+        if (str[0] == '[')
+        {
+            inentry = str == "[Desktop Entry]";
+            continue;
+        }
+        size_t eq = str.find('=');
+        if (inentry && eq != std::string::npos)
+            keys[Trim(str.substr(0, eq))] = Trim(str.substr(eq + 1));
+    }
+    fclose(f);
+
+    if (keys["Type"] != "Application" || keys["Hidden"] == "true" ||
+        !keys["OnlyShowIn"].empty() || keys["Exec"].empty())
+        return false;
+    if (!keys["TryExec"].empty() && !Executable(keys["TryExec"]))
+        return false;
+    program = StripFieldCodes(keys["Exec"]);
+    return !program.empty();
+}
+
+void AutostartPrograms(std::vector<std::string> &programs)
+{
+    // Directories in order of preference
+    std::vector<std::string> dirs;
+    const char *home = getenv("HOME");
+    const char *config_home = getenv("XDG_CONFIG_HOME");
+    if (config_home && *config_home)
+        dirs.push_back(config_home);
+    else if (home && *home)
+        dirs.push_back(std::string(home) + "/.config");
+    const char *config_dirs = getenv("XDG_CONFIG_DIRS");
+    std::string system = (config_dirs && *config_dirs) ? config_dirs : "/etc/xdg";
+    size_t pos = 0;
+    while (pos <= system.size())
+    {
+        size_t end = system.find(':', pos);
+        if (end == std::string::npos)
+            end = system.size();
+        if (end > pos)
+            dirs.push_back(system.substr(pos, end - pos));
+        pos = end + 1;
+    }
+
+    // The first entry of a name wins, even if it is hidden
+    std::map<std::string, std::string> entries;
+    for (size_t i = 0; i < dirs.size(); i++)
+    {
+        std::string dir = dirs[i] + "/autostart";
+        DIR *d = opendir(dir.c_str());
+        if (d == NULL)
+            continue;
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL)
+        {
+            std::string name(entry->d_name);
+            if (name.size() > 8 && name.compare(name.size() - 8, 8, ".desktop") == 0 &&
+                entries.find(name) == entries.end())
+                entries[name] = dir + "/" + name;
+        }
+        closedir(d);
+    }
+
+    for (std::map<std::string, std::string>::iterator i = entries.begin(); i != entries.end(); ++i)
+    {
+        std::string program;
+        if (ReadEntry(i->second, program))
+            programs.push_back(program);
+    }
+}
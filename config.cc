@@ -24,178 +24,304 @@
  * use or other dealings in this Software without prior written authorization.
  */
 #include <libxml/parser.h>
-#include <libxml/tree.h>
+#include <libxml/xmlreader.h>
+#include <pthread.h>
 #include "config.h"
-#include "window/util.h"
+#include "config_schema.h"
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-xmlDocPtr CreateDocument()
+static pthread_once_t parser_once = PTHREAD_ONCE_INIT;
+static pthread_key_t reader_key;
+/* Held shared by loads, and exclusively to tear the parser down */
+static pthread_rwlock_t parser_lock = PTHREAD_RWLOCK_INITIALIZER;
+static volatile bool parser_closing = false;
+static bool parser_gone = false;
+
+/// @brief Use of the parser by a load.
+/// The exit handler may run while other threads are still loading, so it
+/// waits for the loads in progress, and later ones fail. Those don't even
+/// take the lock, as busy readers would keep the exit handler out for good.
+class CParserUse
 {
-  xmlDocPtr doc = xmlNewDoc(BAD_CAST "1.0");
-  xmlNodePtr root_node = xmlNewNode(NULL, BAD_CAST "XLaunch");
-  xmlDocSetRootElement(doc, root_node);
+  private:
+    bool held;
+  public:
+    CParserUse() : held(false)
+    {
+      if (__atomic_load_n(&parser_closing, __ATOMIC_ACQUIRE))
+        return;
+      pthread_rwlock_rdlock(&parser_lock);
+      held = true;
+    }
+    ~CParserUse()
+    {
+      if (held)
+        pthread_rwlock_unlock(&parser_lock);
+    }
+    bool Usable() const { return held && !parser_gone; }
+};
 
-  return doc;
+static void FreeReader(void *reader)
+{
+  CParserUse use;
+  if (use.Usable())
+    xmlFreeTextReader((xmlTextReaderPtr)reader);
+}
 
+static void CleanupParser()
+{
+  __atomic_store_n(&parser_closing, true, __ATOMIC_RELEASE);
+  pthread_rwlock_wrlock(&parser_lock);
+  // Other threads' readers are gone with them or left to the exit, only ours is freed
+  xmlTextReaderPtr reader = (xmlTextReaderPtr)pthread_getspecific(reader_key);
+  if (reader)
+  {
+    pthread_setspecific(reader_key, NULL);
+    xmlFreeTextReader(reader);
+  }
+  xmlCleanupParser();
+  parser_gone = true;
+  pthread_rwlock_unlock(&parser_lock);
 }
 
-void setAttribute(xmlNodePtr elem, const char *name, const char *value)
+/// @brief Set up libxml2 once for all threads, and tear it down at exit.
+static void InitParser()
 {
-  xmlNewProp(elem, BAD_CAST name, BAD_CAST value);
+  xmlInitParser();
+  pthread_key_create(&reader_key, FreeReader);
+  atexit(CleanupParser);
 }
 
-void CConfig::Save(const char *filename)
+/// @brief Get the reader of this thread, set up to read a file.
+/// Each thread keeps its reader, so loads don't set up a new one every time.
+static xmlTextReaderPtr ReaderForFile(const char *filename)
 {
-    xmlDocPtr doc = CreateDocument();
-    xmlNodePtr root = xmlDocGetRootElement(doc);
+  pthread_once(&parser_once, InitParser);
+  xmlTextReaderPtr reader = (xmlTextReaderPtr)pthread_getspecific(reader_key);
+  if (reader)
+    return xmlReaderNewFile(reader, filename, NULL, 0) == 0 ? reader : NULL;
+  reader = xmlReaderForFile(filename, NULL, 0);
+  if (reader)
+    pthread_setspecific(reader_key, reader);
+  return reader;
+}
 
-    switch (window)
-    {
-	case MultiWindow:
-	    setAttribute(root, "WindowMode", "MultiWindow");
-	    break;
-	case Fullscreen:
-	    setAttribute(root, "WindowMode", "Fullscreen");
-	    break;
-	default:
-	case Windowed:
-	    setAttribute(root, "WindowMode", "Windowed");
-	    break;
-	case Nodecoration:
-	    setAttribute(root, "WindowMode", "Nodecoration");
-	    break;
-    }
-    switch (client)
+/// @brief Get the reader of this thread, set up to read a buffer.
+static xmlTextReaderPtr ReaderForMemory(const char *buffer, size_t size)
+{
+  pthread_once(&parser_once, InitParser);
+  xmlTextReaderPtr reader = (xmlTextReaderPtr)pthread_getspecific(reader_key);
+  if (reader)
+    return xmlReaderNewMemory(reader, buffer, size, "inline.xlaunch", NULL, 0) == 0 ? reader : NULL;
+  reader = xmlReaderForMemory(buffer, size, "inline.xlaunch", NULL, 0);
+  if (reader)
+    pthread_setspecific(reader_key, reader);
+  return reader;
+}
+
+/// @brief Append an attribute, escaped as libxml2 would write it.
+static void AppendAttribute(std::string &out, const char *name, const std::string &value)
+{
+  out += ' ';
+  out += name;
+  out += "=\"";
+  for (size_t i = 0; i < value.size(); i++)
+  {
+    switch (value[i])
     {
-	default:
-	case NoClient:
-	    setAttribute(root, "ClientMode", "NoClient");
-	    break;
-	case StartProgram:
-	    setAttribute(root, "ClientMode", "StartProgram");
-	    break;
-	case XDMCP:
-	    setAttribute(root, "ClientMode", "XDMCP");
-	    break;
+      case '&': out += "&amp;"; break;
+      case '<': out += "&lt;"; break;
+      case '>': out += "&gt;"; break;
+      case '"': out += "&quot;"; break;
+      case '\n': out += "&#10;"; break;
+      case '\r': out += "&#13;"; break;
+      case '\t': out += "&#9;"; break;
+      default: out += value[i]; break;
     }
-    setAttribute(root, "LocalClient", local?"True":"False");
-    setAttribute(root, "Display", display.c_str());
-    setAttribute(root, "RemoteProtocol", protocol.c_str());
-    setAttribute(root, "LocalProgram", localprogram.c_str());
-    setAttribute(root, "RemoteProgram", remoteprogram.c_str());
-    setAttribute(root, "RemoteHost", host.c_str());
-    setAttribute(root, "RemoteUser", user.c_str());
-    setAttribute(root, "XDMCPHost", xdmcp_host.c_str());
-    setAttribute(root, "XDMCPBroadcast", broadcast?"True":"False");
-    setAttribute(root, "XDMCPIndirect", indirect?"True":"False");
-    setAttribute(root, "Clipboard", clipboard?"True":"False");
-    setAttribute(root, "ExtraParams", extra_params.c_str());
-    setAttribute(root, "Wgl", wgl?"True":"False");
-    setAttribute(root, "DisableAC", disableac?"True":"False");
-    setAttribute(root, "XDMCPTerminate", xdmcpterminate?"True":"False");
-    setAttribute(root, "SSHKeyChain", keychain?"True":"False");
-    setAttribute(root, "SSHTerminal", terminal?"True":"False");
-    setAttribute(root, "ExtraSSH", extra_ssh.c_str());
-
-    xmlSaveFormatFileEnc(filename, doc, "UTF-8", 1);
-
-    /*free the document */
-    xmlFreeDoc(doc);
-
-    /*
-     *Free the global variables that may
-     *have been allocated by the parser.
-     */
-    xmlCleanupParser();
+  }
+  out += '"';
 }
 
-BOOL getAttribute(xmlNodePtr elem, const char *name, std::string &ret)
+/// @brief Flush the directory entries of the directory holding a file.
+static bool SyncDirectory(const char *filename)
 {
-  char *pVal=(char*)xmlGetProp(elem,BAD_CAST name);
-  if (!pVal)
-    return false;
-  ret=pVal;
-  return true;
+  const char *slash = strrchr(filename, '/');
+  const char *backslash = strrchr(filename, '\\');
+  if (backslash > slash)
+    slash = backslash;
+  std::string dir = slash == NULL ? "." : slash == filename ? "/" : std::string(filename, slash);
+
+  // A directory we may write to but not read can't be synced, nor can
+  // every file system sync directories
+  int fd = open(dir.c_str(), O_RDONLY);
+  if (fd < 0)
+    return true;
+  bool ok = fsync(fd) == 0 || errno == EINVAL || errno == EBADF;
+  int error = errno;
+  close(fd);
+  errno = error;
+  return ok;
 }
 
-BOOL getAttributeBool(xmlNodePtr elem, const char *name, bool &ret)
+/// @brief Replace a file with new contents.
+/// The contents go to a new file next to it, which is flushed to disk and
+/// renamed over the old one, so readers and crashes see either version but
+/// never a mix. The rename itself is flushed too.
+static bool ReplaceFile(const char *filename, const std::string &content)
 {
-  const char *pVal=(char*)xmlGetProp(elem, BAD_CAST name);
-  if (!pVal)
+  static volatile long counter;
+  char suffix[48];
+  snprintf(suffix, sizeof(suffix), ".%ld.%ld.tmp", (long)getpid(),
+           __sync_add_and_fetch(&counter, 1));
+  std::string temp = std::string(filename) + suffix;
+
+  // Created with the umask, like a new file, and with the mode of the old one if there is one
+  int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (stat(filename, &st) == 0)
+    fchmod(fd, st.st_mode & 07777);
+
+  bool ok = true;
+  for (size_t done = 0; ok && done < content.size(); )
+  {
+    ssize_t written = write(fd, content.data() + done, content.size() - done);
+    if (written < 0 && errno == EINTR)
+      continue;
+    ok = written > 0;
+    if (ok)
+      done += written;
+  }
+  ok = ok && fsync(fd) == 0;
+  if (close(fd) != 0 || !ok || rename(temp.c_str(), filename) != 0)
+  {
+    int error = errno;
+    unlink(temp.c_str());
+    errno = error;
     return false;
+  }
+  return SyncDirectory(filename);
+}
 
-  std::string str(pVal);
+void CConfig::Save(const char *filename)
+{
+    // The same document xmlSaveFormatFileEnc() writes, without building it first
+    std::string out = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<XLaunch";
+    for (size_t i = 0; i < config_field_count; i++)
+      AppendAttribute(out, config_fields[i].name, GetConfigField(*this, config_fields[i]));
 
-  if (str == "True")
-    ret = true;
-  else
-    ret = false;
-  return true;
+    if (clients.empty())
+      out += "/>\n";
+    else
+    {
+      out += ">\n";
+      for (size_t i = 0; i < clients.size(); i++)
+      {
+        out += "  <Client";
+        AppendAttribute(out, "Local", clients[i].local ? "True" : "False");
+        AppendAttribute(out, "Program", clients[i].program);
+        out += "/>\n";
+      }
+      out += "</XLaunch>\n";
+    }
+
+    if (!ReplaceFile(filename, out))
+      throw std::runtime_error(std::string("Can't save ") + filename + ": " + strerror(errno));
 }
 
+/// @brief Collect a parse error instead of printing it.
+static void ReportError(void *arg, const char *msg, xmlParserSeverities severity,
+                        xmlTextReaderLocatorPtr locator)
+{
+  std::vector<CConfigProblem> *problems = (std::vector<CConfigProblem> *)arg;
+  std::string message(msg);
+  while (!message.empty() && (message[message.size() - 1] == '\n' || message[message.size() - 1] == ' '))
+    message.erase(message.size() - 1);
+  char line[32];
+  snprintf(line, sizeof(line), "line %d: ", xmlTextReaderLocatorLineNumber(locator));
+  problems->push_back(CConfigProblem("", line + message));
+}
 
-void CConfig::Load(const char *filename)
+bool CConfig::Load(const char *filename, std::vector<CConfigProblem> *problems)
 {
-  xmlDocPtr doc = xmlReadFile(filename, NULL, 0);
+  CParserUse use;
+  xmlTextReaderPtr reader = use.Usable() ? ReaderForFile(filename) : NULL;
 
-  xmlNodePtr root;
+  if (reader == NULL)
+  {
+    if (problems)
+      problems->push_back(CConfigProblem("", "can't open file"));
+    return false;
+  }
+
+  return Load(reader, problems);
+}
 
-  if (doc == NULL)
+void CConfig::LoadFromMemory(const char *buffer, size_t size)
+{
+  CParserUse use;
+  xmlTextReaderPtr reader = use.Usable() ? ReaderForMemory(buffer, size) : NULL;
+
+  if (reader == NULL || !Load(reader, NULL))
   {
-    return;
+    throw std::runtime_error("Can't parse configuration");
   }
+}
 
-  root = xmlDocGetRootElement(doc);
+bool CConfig::Load(xmlTextReaderPtr reader, std::vector<CConfigProblem> *problems)
+{
+  // Nothing changes unless the whole document parses
+  CConfigReader parsed(*this, problems);
+  size_t reported = problems ? problems->size() : 0;
+  int ret;
 
-  std::string windowMode;
-  std::string clientMode;
+  // The reader is reused, so this also puts back the default handler
+  xmlTextReaderSetErrorHandler(reader, problems ? ReportError : NULL, problems);
 
-    if (getAttribute(root, "WindowMode", windowMode))
+  while ((ret = xmlTextReaderRead(reader)) == 1)
+  {
+    if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT)
+      continue;
+    int depth = xmlTextReaderDepth(reader);
+    if (depth == 0)
     {
-	if (windowMode == "MultiWindow")
-	    window = MultiWindow;
-	else if (windowMode == "Fullscreen")
-	    window = Fullscreen;
-	else if (windowMode == "Windowed")
-	    window = Windowed;
-	else if (windowMode == "Nodecoration")
-	    window = Nodecoration;
+      while (xmlTextReaderMoveToNextAttribute(reader) == 1)
+        parsed.Attribute((const char *)xmlTextReaderConstName(reader),
+                         (const char *)xmlTextReaderConstValue(reader));
     }
-    if (getAttribute(root, "ClientMode", clientMode))
+    else if (depth == 1 && xmlStrEqual(xmlTextReaderConstName(reader), BAD_CAST "Client"))
     {
-	if (clientMode == "NoClient")
-	    client = NoClient;
-	else if (clientMode == "StartProgram")
-	    client = StartProgram;
-	else if (clientMode == "XDMCP")
-	    client = XDMCP;
+      CClientEntry entry;
+      while (xmlTextReaderMoveToNextAttribute(reader) == 1)
+      {
+        const char *name = (const char *)xmlTextReaderConstName(reader);
+        const char *value = (const char *)xmlTextReaderConstValue(reader);
+        if (strcmp(name, "Local") == 0)
+          entry.local = strcmp(value, "True") == 0;
+        else if (strcmp(name, "Program") == 0)
+          entry.program = value;
+      }
+      parsed.Client(entry);
     }
+  }
+  // Let go of the input, the reader is kept for the next load
+  xmlTextReaderClose(reader);
 
-    getAttributeBool(root, "LocalClient", local);
-    getAttribute(root, "Display", display);
-    getAttribute(root, "RemoteProtocol", protocol);
-    getAttribute(root, "LocalProgram", localprogram);
-    getAttribute(root, "RemoteProgram", remoteprogram);
-    getAttribute(root, "RemoteHost", host);
-    getAttribute(root, "RemoteUser", user);
-    getAttribute(root, "XDMCPHost", xdmcp_host);
-    getAttributeBool(root, "XDMCPBroadcast", broadcast);
-    getAttributeBool(root, "XDMCPIndirect", indirect);
-    getAttributeBool(root, "Clipboard", clipboard);
-    getAttribute(root, "ExtraParams", extra_params);
-    getAttributeBool(root, "Wgl", wgl);
-    getAttributeBool(root, "DisableAC", disableac);
-    getAttributeBool(root, "XDMCPTerminate", xdmcpterminate);
-    getAttributeBool(root, "SSHKeyChain", keychain);
-    getAttributeBool(root, "SSHTerminal", terminal);
-    getAttribute(root, "ExtraSSH", extra_ssh);
-
-    /*free the document */
-    xmlFreeDoc(doc);
-
-    /*
-     *Free the global variables that may
-     *have been allocated by the parser.
-     */
-    xmlCleanupParser();
+  if (ret != 0)
+  {
+    // A reused reader doesn't always pass on what went wrong
+    if (problems && problems->size() == reported)
+      problems->push_back(CConfigProblem("", "not a well-formed configuration"));
+    return false;
+  }
+  parsed.Finish(*this);
+  return true;
 }
@@ -27,55 +27,86 @@
 #define __CONFIG_H__
 
 #include <string>
+#include <vector>
+#include "intern.h"
+
+/// @brief An additional program to start with the X server.
+struct CClientEntry
+{
+    bool local;             /// Start it here, or on the remote host of the configuration.
+    CInternedString program;
+    CClientEntry(bool local = true, const CInternedString &program = CInternedString()) :
+        local(local), program(program) {}
+};
+
+/// @brief Something wrong with a configuration.
+struct CConfigProblem
+{
+    std::string field;      /// Attribute concerned, or empty for the document.
+    std::string message;
+    bool warning;           /// The configuration can be used anyway, eg. an unknown attribute.
+    CConfigProblem(const std::string &field, const std::string &message, bool warning = false) :
+        field(field), message(message), warning(warning) {}
+};
+
 struct CConfig
 {
-    enum {MultiWindow, Fullscreen, Windowed, Nodecoration} window;
-    enum {NoClient, StartProgram, XDMCP} client;
+    enum WindowMode {MultiWindow, Fullscreen, Windowed, Nodecoration} window;
+    enum ClientMode {NoClient, StartProgram, XDMCP} client;
+    enum RestartMode {RestartNever, RestartOnFailure, RestartAlways} restart;
     bool local;
-    std::string display;
-    std::string protocol;
-    std::string localprogram;
-    std::string remoteprogram;
-    std::string host;
-    std::string user;
+    CInternedString display;
+    CInternedString protocol;
+    CInternedString localprogram;
+    CInternedString remoteprogram;
+    CInternedString host;
+    CInternedString user;
     bool broadcast;
     bool indirect;
-    std::string xdmcp_host;
+    CInternedString xdmcp_host;
     bool clipboard;
     bool wgl;
     bool disableac;
     bool xdmcpterminate;
-    std::string extra_params;
+    CInternedString extra_params;
     bool keychain;
     bool terminal;
-    std::string extra_ssh;
-    CConfig() : window(MultiWindow),
-                client(NoClient),
-                local(true),
-#ifdef _DEBUG
-                display("1"),
-#else
-                display("0"),
-#endif
-                localprogram("xterm"),
-                remoteprogram("xterm"),
-                host(""),
-                user(""),
-                broadcast(false),
-                indirect(false),
-                xdmcp_host(""),
-                clipboard(true),
-                wgl(true),
-                disableac(false),
-                xdmcpterminate(false),
-                extra_params(),
-                keychain(false),
-                terminal(true),
-                extra_ssh()
-    {
-    };
-    void Load(const char * filename);
+    CInternedString extra_ssh;
+    unsigned int server_timeout;
+    unsigned int monitor_interval;
+    unsigned int hung_timeout;
+    unsigned int restart_delay;
+    unsigned int restart_max_delay;
+    unsigned int restart_limit;
+    unsigned int restart_window;
+    bool keep_server;
+    std::vector<CClientEntry> clients;
+    bool autostart;
+    unsigned int shutdown_timeout;
+    bool cache_login_env;
+    /// @brief A configuration with the defaults of the schema, see config_schema.h.
+    CConfig();
+    /// @brief Load a configuration file.
+    /// @param problems If given, receives parse errors, unknown attributes
+    /// and invalid values instead of them being printed or ignored.
+    /// @return false if the file can't be read or parsed. Nothing was changed then.
+    bool Load(const char * filename, std::vector<CConfigProblem> *problems = NULL);
+    /// @brief Load a configuration held in memory, eg. received from a client.
+    /// @throws std::runtime_error if it can't be parsed.
+    void LoadFromMemory(const char *buffer, size_t size);
+    /// @brief Save the configuration, replacing the file in one step.
+    /// @throws std::runtime_error if it can't be written. The file is unchanged then.
     void Save(const char * filename);
+    /// @brief Check that the configuration can be run, with the same rules
+    /// as the wizard.
+    /// @param problems Receives the problems found.
+    /// @return false if there were any.
+    bool Validate(std::vector<CConfigProblem> &problems) const;
+  private:
+    /// @brief Take the options from a document in a single pass over it,
+    /// and close the reader.
+    /// @return false if the document can't be parsed. Nothing was changed then.
+    bool Load(struct _xmlTextReader *reader, std::vector<CConfigProblem> *problems);
 };
 
 #endif
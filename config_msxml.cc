@@ -24,13 +24,16 @@
  * use or other dealings in this Software without prior written authorization.
  */
 #include "config.h"
+#include "config_schema.h"
 #include "window/util.h"
 #include <msxml2.h>
 #include <stdexcept>
+#include <stdio.h>
 
 const CLSID CLSID_DOMDocument40 = {0x88d969c0,0xf192,0x11d4,0xa6,0x5f,0x00,0x40,0x96,0x32,0x51,0xe5};
 const CLSID CLSID_DOMDocument30 = {0xf5078f32,0xc551,0x11d3,0x89,0xb9,0x00,0x00,0xf8,0x1f,0xe2,0x21};
 const IID IID_IXMLDOMDocument2 = {0x2933BF95,0x7B36,0x11d2,0xB2,0x0E,0x00,0xC0,0x4F,0x98,0x3E,0x60};
+const IID IID_IXMLDOMElement = {0x2933BF86,0x7B36,0x11d2,0xB2,0x0E,0x00,0xC0,0x4F,0x98,0x3E,0x60};
 
 #define HRCALL(x, msg) if (FAILED(x)) { throw std::runtime_error("OLE Error:" msg " failed"); };
 
@@ -143,55 +146,52 @@ void CConfig::Save(const char *filename)
 
     HRCALL(doc->get_documentElement(&root), "get_documentElement");
 
-    switch (window)
+    for (size_t i = 0; i < config_field_count; i++)
     {
-	case MultiWindow:
-	    setAttribute(root, L"WindowMode", L"MultiWindow");
-	    break;
-	case Fullscreen:
-	    setAttribute(root, L"WindowMode", L"Fullscreen");
-	    break;
-	default:
-	case Windowed:
-	    setAttribute(root, L"WindowMode", L"Windowed");
-	    break;
-	case Nodecoration:
-	    setAttribute(root, L"WindowMode", L"Nodecoration");
-	    break;
+	wchar_t *name = mbconvert(config_fields[i].name);
+	setAttribute(root, name, GetConfigField(*this, config_fields[i]).c_str());
+	delete [] name;
     }
-    switch (client)
+
+    BSTR elemname = SysAllocString(L"Client");
+    for (size_t i = 0; i < clients.size(); i++)
     {
-	default:
-	case NoClient:
-	    setAttribute(root, L"ClientMode", L"NoClient");
-	    break;
-	case StartProgram:
-	    setAttribute(root, L"ClientMode", L"StartProgram");
-	    break;
-	case XDMCP:
-	    setAttribute(root, L"ClientMode", L"XDMCP");
-	    break;
+	IXMLDOMElement *elem = NULL;
+	HRCALL(doc->createElement(elemname, &elem), "createElement");
+	setAttribute(elem, L"Local", clients[i].local?L"True":L"False");
+	setAttribute(elem, L"Program", clients[i].program.c_str());
+	HRCALL(root->appendChild(elem, NULL), "appendChild");
+	elem->Release();
     }
-    setAttribute(root, L"LocalClient", local?L"True":L"False");
-    setAttribute(root, L"Display", display.c_str());
-    setAttribute(root, L"Program", program.c_str());
-    setAttribute(root, L"RemoteProtocol", protocol.c_str());
-    setAttribute(root, L"RemoteHost", host.c_str());
-    setAttribute(root, L"RemoteUser", user.c_str());
-    setAttribute(root, L"XDMCPHost", xdmcp_host.c_str());
-    setAttribute(root, L"XDMCPBroadcast", broadcast?L"True":L"False");
-    setAttribute(root, L"XDMCPIndirect", indirect?L"True":L"False");
-    setAttribute(root, L"Clipboard", clipboard?L"True":L"False");
-    setAttribute(root, L"ExtraParams", extra_params.c_str());
-    setAttribute(root, L"Wgl", wgl?L"True":L"False");
+    SysFreeString(elemname);
 
-    VARIANT var = VariantString(filename);
-    HRCALL(doc->save(var), "save");
+    // Saved next to the file and moved over it, so it is replaced in one step
+    char temp[MAX_PATH + 32];
+    snprintf(temp, sizeof(temp), "%s.%lu.tmp", filename, GetCurrentProcessId());
+    VARIANT var = VariantString(temp);
+    HRESULT hr = doc->save(var);
     VariantClear(&var);
 
-
     root->Release();
     doc->Release();
+
+    if (FAILED(hr))
+    {
+	DeleteFile(temp);
+	throw std::runtime_error("OLE Error:save failed");
+    }
+
+    HANDLE file = CreateFile(temp, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    BOOL flushed = file != INVALID_HANDLE_VALUE && FlushFileBuffers(file);
+    if (file != INVALID_HANDLE_VALUE)
+	CloseHandle(file);
+    if (!flushed || !MoveFileEx(temp, filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+	DWORD error = GetLastError();
+	DeleteFile(temp);
+	SetLastError(error);
+	throw win32_error("MoveFileEx");
+    }
 }
 
 BOOL getAttribute(IXMLDOMElement *elem, const wchar_t *name, std::string &ret)
@@ -203,80 +203,145 @@ BOOL getAttribute(IXMLDOMElement *elem, const wchar_t *name, std::string &ret)
 	char *str = wcconvert(V_BSTR(&var));
 	ret = str;
 	delete [] str;
+	VariantClear(&var);
 	return true;
     }
     return false;
 }
 
-BOOL getAttributeBool(IXMLDOMElement *elem, const wchar_t *name, bool &ret)
+/// @brief Take the options from a loaded document and release it.
+static void LoadDocument(IXMLDOMDocument2 *doc, CConfig &config,
+                         std::vector<CConfigProblem> *problems)
 {
-    std::string str;
-    if (getAttribute(elem, name, str))
+    IXMLDOMElement *root = NULL;
+    IXMLDOMNamedNodeMap *attributes = NULL;
+    IXMLDOMNodeList *children = NULL;
+    CConfigReader parsed(config, problems);
+
+    try {
+	HRCALL(doc->get_documentElement(&root), "get_documentElement");
+
+	HRCALL(root->get_attributes(&attributes), "get_attributes");
+	long count = 0;
+	HRCALL(attributes->get_length(&count), "get_length");
+	for (long i = 0; i < count; i++)
+	{
+	    IXMLDOMNode *attribute = NULL;
+	    BSTR name = NULL, value = NULL;
+	    HRCALL(attributes->get_item(i, &attribute), "get_item");
+	    if (SUCCEEDED(attribute->get_nodeName(&name)) && SUCCEEDED(attribute->get_text(&value)))
+	    {
+		char *mbname = wcconvert(name);
+		char *mbvalue = wcconvert(value);
+		parsed.Attribute(mbname, mbvalue);
+		delete [] mbname;
+		delete [] mbvalue;
+	    }
+	    SysFreeString(name);
+	    SysFreeString(value);
+	    attribute->Release();
+	}
+
+	BSTR query = SysAllocString(L"Client");
+	HRESULT hr = root->selectNodes(query, &children);
+	SysFreeString(query);
+	HRCALL(hr, "selectNodes");
+	count = 0;
+	HRCALL(children->get_length(&count), "get_length");
+	for (long i = 0; i < count; i++)
+	{
+	    IXMLDOMNode *node = NULL;
+	    IXMLDOMElement *elem = NULL;
+	    HRCALL(children->get_item(i, &node), "get_item");
+	    if (SUCCEEDED(node->QueryInterface(IID_IXMLDOMElement, (void**)&elem)))
+	    {
+		CClientEntry entry;
+		std::string local, program;
+		if (getAttribute(elem, L"Local", local))
+		    entry.local = local == "True";
+		if (getAttribute(elem, L"Program", program))
+		    entry.program = program;
+		parsed.Client(entry);
+		elem->Release();
+	    }
+	    node->Release();
+	}
+    } catch (...)
     {
-	if (str == "True")
-	    ret = true;
-	else
-	    ret = false;
-	return true;
+	if (children)
+	    children->Release();
+	if (attributes)
+	    attributes->Release();
+	if (root)
+	    root->Release();
+	doc->Release();
+	throw;
     }
-    return false;
-}
 
+    children->Release();
+    attributes->Release();
+    root->Release();
+    doc->Release();
+    parsed.Finish(config);
+}
 
-void CConfig::Load(const char *filename)
+bool CConfig::Load(const char *filename, std::vector<CConfigProblem> *problems)
 {
     IXMLDOMDocument2 *doc = CreateDocument();
-    IXMLDOMElement *root = NULL;
 
     VARIANT var = VariantString(filename);
     VARIANT_BOOL status;
-    HRCALL(doc->load(var, &status), "load");
+    HRESULT hr = doc->load(var, &status);
     VariantClear(&var);
 
-    if (status == VARIANT_FALSE)
+    if (FAILED(hr) || status == VARIANT_FALSE)
     {
+	if (problems)
+	{
+	    std::string message = "can't parse file";
+	    IXMLDOMParseError *error = NULL;
+	    BSTR reason = NULL;
+	    long line = 0;
+	    if (SUCCEEDED(doc->get_parseError(&error)))
+	    {
+		if (SUCCEEDED(error->get_reason(&reason)) && reason)
+		{
+		    char *str = wcconvert(reason);
+		    message = str;
+		    delete [] str;
+		    SysFreeString(reason);
+		}
+		error->get_line(&line);
+		error->Release();
+	    }
+	    char prefix[32];
+	    snprintf(prefix, sizeof(prefix), "line %ld: ", line);
+	    problems->push_back(CConfigProblem("", prefix + message));
+	}
 	doc->Release();
-	return;
+	return false;
     }
 
-    HRCALL(doc->get_documentElement(&root), "get_documentElement");
+    LoadDocument(doc, *this, problems);
+    return true;
+}
 
-    std::string windowMode;
-    std::string clientMode;
+void CConfig::LoadFromMemory(const char *buffer, size_t size)
+{
+    IXMLDOMDocument2 *doc = CreateDocument();
 
-    if (getAttribute(root, L"WindowMode", windowMode))
-    {
-	if (windowMode == "MultiWindow")
-	    window = MultiWindow;
-	else if (windowMode == "Fullscreen")
-	    window = Fullscreen;
-	else if (windowMode == "Windowed")
-	    window = Windowed;
-	else if (windowMode == "Nodecoration")
-	    window = Nodecoration;
-    }
-    if (getAttribute(root, L"ClientMode", clientMode))
+    wchar_t *wstr = mbconvert(std::string(buffer, size).c_str());
+    BSTR xml = SysAllocString(wstr);
+    delete [] wstr;
+    VARIANT_BOOL status;
+    HRESULT hr = doc->loadXML(xml, &status);
+    SysFreeString(xml);
+
+    if (FAILED(hr) || status == VARIANT_FALSE)
     {
-	if (clientMode == "NoClient")
-	    client = NoClient;
-	else if (clientMode == "StartProgram")
-	    client = StartProgram;
-	else if (clientMode == "XDMCP")
-	    client = XDMCP;
+	doc->Release();
+	throw std::runtime_error("Can't parse configuration");
     }
 
-    getAttributeBool(root, L"LocalClient", local);
-    getAttribute(root, L"Display", display);
-    getAttribute(root, L"Program", program);
-    getAttribute(root, L"RemoteProtocol", protocol);
-    getAttribute(root, L"RemoteHost", host);
-    getAttribute(root, L"RemoteUser", user);
-    getAttribute(root, L"XDMCPHost", xdmcp_host);
-    getAttributeBool(root, L"XDMCPBroadcast", broadcast);
-    getAttributeBool(root, L"XDMCPIndirect", indirect);
-    getAttributeBool(root, L"Clipboard", clipboard);
-    getAttribute(root, L"ExtraParams", extra_params);
-    getAttributeBool(root, L"Wgl", wgl);
-
-    doc->Release();
+    LoadDocument(doc, *this, NULL);
 }
@@ -0,0 +1,405 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "config_schema.h"
+#include "launchspawn.h"
+
+template <typename E, E CConfig::*member>
+static int GetChoice(const CConfig &config)
+{
+    return config.*member;
+}
+
+template <typename E, E CConfig::*member>
+static void SetChoice(CConfig &config, int value)
+{
+    config.*member = (E)value;
+}
+
+static const char *const window_choices[] = { "MultiWindow", "Fullscreen", "Windowed", "Nodecoration", NULL };
+static const char *const client_choices[] = { "NoClient", "StartProgram", "XDMCP", NULL };
+static const char *const restart_choices[] = { "Never", "OnFailure", "Always", NULL };
+/* The protocols ClientCommand() knows, with any other no client starts */
+static const char *const protocol_choices[] = { "ssh", "rsh", NULL };
+
+/* When the strings are used, so must be given */
+static bool Always(const CConfig &) { return true; }
+static bool LocalClient(const CConfig &config)
+{
+    return config.client == CConfig::StartProgram && config.local;
+}
+static bool RemoteClient(const CConfig &config)
+{
+    return config.client == CConfig::StartProgram && !config.local;
+}
+static bool XDMCPQuery(const CConfig &config)
+{
+    return config.client == CConfig::XDMCP && !config.broadcast;
+}
+
+#define STRING(name, member, def, scope, check, needed, choices) \
+    { name, CConfigField::String, &CConfig::member, NULL, NULL, NULL, NULL, choices, def, \
+      CConfigField::scope, CConfigField::check, needed }
+#define FLAG(name, member, def, scope) \
+    { name, CConfigField::Bool, NULL, &CConfig::member, NULL, NULL, NULL, NULL, def, \
+      CConfigField::scope, CConfigField::Any, NULL }
+#define NUMBER(name, member, def, scope) \
+    { name, CConfigField::Number, NULL, NULL, &CConfig::member, NULL, NULL, NULL, def, \
+      CConfigField::scope, CConfigField::Any, NULL }
+#define CHOICE(name, type, member, choices, def, scope) \
+    { name, CConfigField::Choice, NULL, NULL, NULL, \
+      &GetChoice<CConfig::type, &CConfig::member>, &SetChoice<CConfig::type, &CConfig::member>, \
+      choices, def, CConfigField::scope, CConfigField::Any, NULL }
+
+constexpr CConfigField config_fields[] = {
+    CHOICE("WindowMode", WindowMode, window, window_choices, "MultiWindow", Server),
+    CHOICE("ClientMode", ClientMode, client, client_choices, "NoClient", Server),
+    CHOICE("Restart", RestartMode, restart, restart_choices, "Never", Session),
+    FLAG("LocalClient", local, "True", Server),
+#ifdef _DEBUG
+    STRING("Display", display, "1", Server, DisplayNumber, Always, NULL),
+#else
+    STRING("Display", display, "0", Server, DisplayNumber, Always, NULL),
+#endif
+    STRING("RemoteProtocol", protocol, "", Client, Any, RemoteClient, protocol_choices),
+    STRING("LocalProgram", localprogram, "xterm", Client, Command, LocalClient, NULL),
+    STRING("RemoteProgram", remoteprogram, "xterm", Client, Command, RemoteClient, NULL),
+    STRING("RemoteHost", host, "", Client, Any, RemoteClient, NULL),
+    STRING("RemoteUser", user, "", Client, Any, NULL, NULL),
+    STRING("XDMCPHost", xdmcp_host, "", Server, Any, XDMCPQuery, NULL),
+    FLAG("XDMCPBroadcast", broadcast, "False", Server),
+    FLAG("XDMCPIndirect", indirect, "False", Server),
+    FLAG("Clipboard", clipboard, "True", Server),
+    STRING("ExtraParams", extra_params, "", Server, Arguments, NULL, NULL),
+    FLAG("Wgl", wgl, "True", Server),
+    FLAG("DisableAC", disableac, "False", Server),
+    FLAG("XDMCPTerminate", xdmcpterminate, "False", Server),
+    FLAG("SSHKeyChain", keychain, "False", Client),
+    FLAG("SSHTerminal", terminal, "True", Client),
+    STRING("ExtraSSH", extra_ssh, "", Client, Arguments, NULL, NULL),
+    NUMBER("ServerTimeout", server_timeout, "120", Session),
+    NUMBER("MonitorInterval", monitor_interval, "5", Session),
+    NUMBER("HungTimeout", hung_timeout, "10", Session),
+    NUMBER("RestartDelay", restart_delay, "250", Session),
+    NUMBER("RestartMaxDelay", restart_max_delay, "30000", Session),
+    NUMBER("RestartLimit", restart_limit, "5", Session),
+    NUMBER("RestartWindow", restart_window, "60", Session),
+    FLAG("KeepServer", keep_server, "False", Session),
+    FLAG("XDGAutostart", autostart, "False", Client),
+    NUMBER("ShutdownTimeout", shutdown_timeout, "5", Session),
+    FLAG("CacheLoginEnvironment", cache_login_env, "False", Client),
+};
+
+#define FIELD_COUNT (sizeof(config_fields) / sizeof(config_fields[0]))
+
+const size_t config_field_count = FIELD_COUNT;
+
+static constexpr unsigned Hash(const char *name, unsigned seed)
+{
+    // FNV-1a, started from the seed
+    unsigned hash = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (; *name; name++)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    // The low bits of FNV only depend on the low bits of the input, mix the
+    // high ones in so that the slot, taken from the low bits, does too
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
+    return hash;
+}
+
+/* Four slots per field leave a collision free seed easy to find */
+static constexpr unsigned SlotCount(size_t fields)
+{
+    unsigned size = 1;
+    while (size < fields * 4)
+        size *= 2;
+    return size;
+}
+
+#define FIELD_SLOTS SlotCount(FIELD_COUNT)
+
+/// @brief Slots of the fields by the hash of their names.
+struct CFieldIndex
+{
+    unsigned seed;
+    int slots[FIELD_SLOTS];
+};
+
+/// @brief Search a seed for which no two names share a slot.
+/// This runs in the compiler, so adding fields needs no tuning by hand and
+/// costs nothing at run time.
+static constexpr CFieldIndex BuildIndex()
+{
+    CFieldIndex index = {};
+    for (;; index.seed++)
+    {
+        for (unsigned slot = 0; slot < FIELD_SLOTS; slot++)
+            index.slots[slot] = -1;
+        size_t i = 0;
+        for (; i < FIELD_COUNT; i++)
+        {
+            int &slot = index.slots[Hash(config_fields[i].name, index.seed) & (FIELD_SLOTS - 1)];
+            if (slot >= 0)
+                break;
+            slot = i;
+        }
+        if (i == FIELD_COUNT)
+            return index;
+    }
+}
+
+static constexpr CFieldIndex field_index = BuildIndex();
+
+const CConfigField *FindConfigField(const char *name)
+{
+    int slot = field_index.slots[Hash(name, field_index.seed) & (FIELD_SLOTS - 1)];
+    if (slot < 0 || strcmp(config_fields[slot].name, name) != 0)
+        return NULL;
+    return &config_fields[slot];
+}
+
+std::string GetConfigField(const CConfig &config, const CConfigField &field)
+{
+    switch (field.type)
+    {
+        case CConfigField::String:
+            return config.*field.string;
+        case CConfigField::Bool:
+            return config.*field.flag ? "True" : "False";
+        case CConfigField::Number:
+        {
+            char buffer[16];
+            snprintf(buffer, sizeof(buffer), "%u", config.*field.number);
+            return buffer;
+        }
+        case CConfigField::Choice:
+        {
+            int value = field.get(config);
+            for (int i = 0; field.choices[i]; i++)
+                if (i == value)
+                    return field.choices[i];
+            return field.def;
+        }
+    }
+    return field.def;
+}
+
+bool SetConfigField(CConfig &config, const CConfigField &field, const char *value)
+{
+    switch (field.type)
+    {
+        case CConfigField::String:
+            config.*field.string = value;
+            return true;
+        case CConfigField::Bool:
+            config.*field.flag = strcmp(value, "True") == 0;
+            return config.*field.flag || strcmp(value, "False") == 0;
+        case CConfigField::Number:
+        {
+            char *end;
+            unsigned long number = strtoul(value, &end, 10);
+            if (!*value || *end)
+                return false;
+            config.*field.number = number;
+            return true;
+        }
+        case CConfigField::Choice:
+            for (int i = 0; field.choices[i]; i++)
+                if (strcmp(field.choices[i], value) == 0)
+                {
+                    field.set(config, i);
+                    return true;
+                }
+            return false;
+    }
+    return false;
+}
+
+bool ConfigChanged(const CConfig &from, const CConfig &to, CConfigField::Scope &scope)
+{
+    bool changed = false;
+    scope = CConfigField::Session;
+    for (size_t i = 0; i < config_field_count; i++)
+    {
+        const CConfigField &field = config_fields[i];
+        if (GetConfigField(from, field) == GetConfigField(to, field))
+            continue;
+        changed = true;
+        if (field.scope > scope)
+            scope = field.scope;
+    }
+
+    bool clients = from.clients.size() != to.clients.size();
+    for (size_t i = 0; !clients && i < from.clients.size(); i++)
+        clients = from.clients[i].local != to.clients[i].local ||
+                  from.clients[i].program != to.clients[i].program;
+    if (clients)
+    {
+        changed = true;
+        if (scope < CConfigField::Client)
+            scope = CConfigField::Client;
+    }
+    return changed;
+}
+
+CConfig::CConfig()
+{
+    for (size_t i = 0; i < config_field_count; i++)
+        SetConfigField(*this, config_fields[i], config_fields[i].def);
+}
+
+CConfigReader::CConfigReader(const CConfig &config, std::vector<CConfigProblem> *problems) :
+    parsed(config), restart(false), hungrestart(false), problems(problems)
+{
+    parsed.clients.clear();
+}
+
+void CConfigReader::Attribute(const char *name, const char *value)
+{
+    const CConfigField *field = FindConfigField(name);
+    if (field)
+    {
+        if (field->choices == restart_choices)
+            restart = true;
+        if (!SetConfigField(parsed, *field, value) && problems)
+            problems->push_back(CConfigProblem(name, std::string("invalid value \"") + value + "\""));
+    }
+    // Older configurations could only restart a hung server
+    else if (strcmp(name, "HungRestart") == 0)
+        hungrestart = strcmp(value, "True") == 0;
+    else if (problems)
+        problems->push_back(CConfigProblem(name, "unknown attribute", true));
+}
+
+/// @brief Check the value of a string field which is used.
+/// @return false if it is not right, with the problem in message.
+static bool CheckField(const CConfigField &field, const std::string &value, std::string &message)
+{
+    if (value.find_first_not_of(" \t") == std::string::npos)
+    {
+        if (!field.needed)
+            return true;
+        message = field.check == CConfigField::Command ? "no program given" :
+            std::string("no ") + field.name + " given";
+        return false;
+    }
+
+    std::vector<std::string> argv;
+    switch (field.check)
+    {
+        case CConfigField::Any:
+            break;
+        case CConfigField::DisplayNumber:
+            if (value != "auto" && value.find_first_not_of("0123456789") != std::string::npos)
+            {
+                message = "display must be a number or auto";
+                return false;
+            }
+            break;
+        case CConfigField::Command:
+            if (value.find_first_of("\r\n") != std::string::npos)
+            {
+                message = "command spans several lines";
+                return false;
+            }
+            break;
+        case CConfigField::Arguments:
+            if (!SplitArguments(value, argv))
+            {
+                message = "unbalanced quotes";
+                return false;
+            }
+            break;
+    }
+
+    if (field.choices)
+    {
+        message = "must be one of";
+        for (int i = 0; field.choices[i]; i++)
+        {
+            if (value == field.choices[i])
+                return true;
+            message += std::string(i ? ", " : " ") + field.choices[i];
+        }
+        return false;
+    }
+    return true;
+}
+
+bool CConfig::Validate(std::vector<CConfigProblem> &problems) const
+{
+    size_t before = problems.size();
+    std::string message;
+
+    // What the table says of each field. Fields only used in some modes
+    // are only checked in those.
+    for (size_t i = 0; i < config_field_count; i++)
+    {
+        const CConfigField &field = config_fields[i];
+        if (field.type != CConfigField::String || (field.needed && !field.needed(*this)))
+            continue;
+        if (!CheckField(field, this->*field.string, message))
+            problems.push_back(CConfigProblem(field.name, message));
+    }
+
+    // Rules between fields
+    if (client == XDMCP && window == MultiWindow)
+        problems.push_back(CConfigProblem("ClientMode", "XDMCP is not available with MultiWindow"));
+
+    // Remote clients need what the remote client of the configuration needs
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        if (!CheckField(*FindConfigField("LocalProgram"), clients[i].program, message))
+            problems.push_back(CConfigProblem("Client", message));
+        if (!clients[i].local &&
+            (!CheckField(*FindConfigField("RemoteHost"), host, message) ||
+             !CheckField(*FindConfigField("RemoteProtocol"), protocol, message)))
+            problems.push_back(CConfigProblem("Client", "remote program without remote host and protocol"));
+    }
+
+    if (restart_delay > restart_max_delay)
+        problems.push_back(CConfigProblem("RestartDelay", "larger than RestartMaxDelay"));
+
+    return problems.size() == before;
+}
+
+void CConfigReader::Client(const CClientEntry &entry)
+{
+    if (!entry.program.empty())
+        parsed.clients.push_back(entry);
+}
+
+void CConfigReader::Finish(CConfig &config)
+{
+    if (!restart && hungrestart)
+        parsed.restart = CConfig::RestartOnFailure;
+    config = parsed;
+}
@@ -0,0 +1,101 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __CONFIG_SCHEMA_H__
+#define __CONFIG_SCHEMA_H__
+
+#include <stddef.h>
+#include <string>
+#include "config.h"
+
+/// @brief Description of one attribute of the XLaunch element.
+/// Loading, saving, checking and the defaults of a CConfig all go by the
+/// table of these, so the backends can't disagree about the format.
+struct CConfigField
+{
+    enum Type { String, Bool, Number, Choice };
+    /// What has to start again for a change to take effect in a running session.
+    enum Scope { Session, Client, Server };
+    /// What CConfig::Validate() checks of a value.
+    enum Check { Any, DisplayNumber, Command, Arguments };
+    const char *name;               /// Attribute name.
+    Type type;
+    CInternedString CConfig::*string; /// String: the member.
+    bool CConfig::*flag;            /// Bool: the member, written as True or False.
+    unsigned int CConfig::*number;  /// Number: the member.
+    int (*get)(const CConfig &);    /// Choice: read the member.
+    void (*set)(CConfig &, int);    /// Choice: set the member.
+    const char *const *choices;     /// Choice: names of the values in order, NULL terminated.
+                                    /// String: the values it may have, or NULL for any.
+    const char *def;                /// Default, as written in a file.
+    Scope scope;
+    Check check;                    /// String: the form of a value.
+    bool (*needed)(const CConfig &); /// String: when it must be given, or NULL if it may be empty.
+};
+
+/// @brief The fields, in the order they are written.
+extern const CConfigField config_fields[];
+extern const size_t config_field_count;
+
+/// @brief Find the field of an attribute.
+/// Uses a perfect hash of the attribute names, so a lookup costs the same
+/// however many fields there are.
+/// @return NULL if there is no such attribute.
+const CConfigField *FindConfigField(const char *name);
+
+/// @brief Get the value of a field as it is written in a file.
+std::string GetConfigField(const CConfig &config, const CConfigField &field);
+
+/// @brief Set a field from its value in a file.
+/// @return false if the value is not valid for the field. A boolean is
+/// set to false then, anything else is left alone.
+bool SetConfigField(CConfig &config, const CConfigField &field, const char *value);
+
+/// @brief Compare two configurations, eg. a file before and after it was edited.
+/// @param scope Receives what has to start again for the differences to
+/// take effect. Client entries count as Client.
+/// @return false if they are the same.
+bool ConfigChanged(const CConfig &from, const CConfig &to, CConfigField::Scope &scope);
+
+/// @brief Collects the attributes of a document as a backend reads them.
+/// The configuration only changes once the whole document was read.
+class CConfigReader
+{
+    private:
+        CConfig parsed;
+        bool restart;       /// The Restart attribute was given.
+        bool hungrestart;   /// Legacy HungRestart attribute.
+        std::vector<CConfigProblem> *problems;
+    public:
+        /// @param config Configuration to start from, for attributes the document lacks.
+        /// @param problems If given, receives unknown attributes and invalid values.
+        CConfigReader(const CConfig &config, std::vector<CConfigProblem> *problems = NULL);
+        /// @brief Take an attribute of the XLaunch element.
+        void Attribute(const char *name, const char *value);
+        /// @brief Take a Client element.
+        void Client(const CClientEntry &entry);
+        /// @brief Store what was read.
+        void Finish(CConfig &config);
+};
+
+#endif
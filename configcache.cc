@@ -0,0 +1,342 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include "configcache.h"
+#include "config_schema.h"
+#include "trace.h"
+
+/*
+ * A compiled configuration is a header, then a pair of 32 bit values for
+ * each field of the schema, in the order of the schema, then two pairs for
+ * each Client element, then the strings. Strings are stored as an offset
+ * into the string area and a length; a boolean, number or choice as its
+ * value and 0. A Client element is its Local flag, then its program.
+ */
+#define CACHE_MAGIC "XLCC"
+#define CACHE_VERSION 1
+
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t schema;        /// Hash of the field table it was written with.
+    uint32_t fields;
+    uint32_t clients;
+    uint32_t strings;       /// Size of the string area.
+    int64_t source_mtime;   /// In ns.
+    uint64_t source_size;
+    uint64_t source_hash;   /// Of the contents of the file.
+    uint64_t content_hash;  /// Of everything after the header.
+};
+
+struct CacheValue
+{
+    uint32_t value;
+    uint32_t length;
+};
+
+typedef unsigned long long Hash;
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+/// @brief Add data to a FNV-1a hash.
+static void HashData(Hash &hash, const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+/// @brief Hash the field table, so a cache written by another version of
+/// the schema is never read.
+static uint32_t ComputeSchemaHash()
+{
+    Hash hash = HASH_INIT;
+    for (size_t i = 0; i < config_field_count; i++)
+    {
+        const CConfigField &field = config_fields[i];
+        HashData(hash, field.name, strlen(field.name) + 1);
+        HashData(hash, &field.type, sizeof(field.type));
+        HashData(hash, field.def, strlen(field.def) + 1);
+        for (int c = 0; field.choices && field.choices[c]; c++)
+            HashData(hash, field.choices[c], strlen(field.choices[c]) + 1);
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static uint32_t SchemaHash()
+{
+    static const uint32_t hash = ComputeSchemaHash();
+    return hash;
+}
+
+static int64_t ModificationTime(const struct stat &st)
+{
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+/// @brief Where the compiled copy of a file is kept.
+/// The user's cache directory, rather than next to the file, so it works
+/// for files on read-only or slow shares too.
+static std::string CachePath(const std::string &source)
+{
+    std::string dir;
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (cache && *cache)
+        dir = cache;
+    else if (home && *home)
+        dir = std::string(home) + "/.cache";
+    else
+        return "";
+    dir += "/xlaunch";
+
+    Hash hash = HASH_INIT;
+    HashData(hash, source.c_str(), source.size());
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", hash);
+    return dir + name;
+}
+
+static void PutValue(std::string &out, uint32_t value, uint32_t length)
+{
+    CacheValue v;
+    v.value = value;
+    v.length = length;
+    out.append((const char *)&v, sizeof(v));
+}
+
+static void PutString(std::string &out, std::string &strings, const std::string &str)
+{
+    PutValue(out, strings.size(), str.size());
+    strings += str;
+}
+
+/// @brief Encode everything after the header.
+static std::string Encode(const CConfig &config)
+{
+    std::string out, strings;
+    for (size_t i = 0; i < config_field_count; i++)
+    {
+        const CConfigField &field = config_fields[i];
+        switch (field.type)
+        {
+            case CConfigField::String:
+                PutString(out, strings, config.*field.string);
+                break;
+            case CConfigField::Bool:
+                PutValue(out, config.*field.flag, 0);
+                break;
+            case CConfigField::Number:
+                PutValue(out, config.*field.number, 0);
+                break;
+            case CConfigField::Choice:
+                PutValue(out, field.get(config), 0);
+                break;
+        }
+    }
+    for (size_t i = 0; i < config.clients.size(); i++)
+    {
+        PutValue(out, config.clients[i].local, 0);
+        PutString(out, strings, config.clients[i].program);
+    }
+    return out + strings;
+}
+
+/// @brief Check a mapped cache file and decode it.
+/// @return false if it is not a valid cache file.
+static bool Decode(const char *data, size_t size, CacheHeader &header, CConfig &config)
+{
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION ||
+        header.schema != SchemaHash() || header.fields != config_field_count)
+        return false;
+
+    size_t values = header.fields + 2 * (size_t)header.clients;
+    if (size != sizeof(header) + values * sizeof(CacheValue) + header.strings)
+        return false;
+    Hash hash = HASH_INIT;
+    HashData(hash, data + sizeof(header), size - sizeof(header));
+    if (hash != header.content_hash)
+        return false;
+
+    const CacheValue *value = (const CacheValue *)(data + sizeof(header));
+    const char *strings = (const char *)(value + values);
+    for (size_t i = 0; i < values; i++)
+        if (value[i].length && (value[i].value > header.strings ||
+                                value[i].length > header.strings - value[i].value))
+            return false;
+
+    for (size_t i = 0; i < config_field_count; i++, value++)
+    {
+        const CConfigField &field = config_fields[i];
+        switch (field.type)
+        {
+            case CConfigField::String:
+                (config.*field.string).assign(strings + value->value, value->length);
+                break;
+            case CConfigField::Bool:
+                config.*field.flag = value->value != 0;
+                break;
+            case CConfigField::Number:
+                config.*field.number = value->value;
+                break;
+            case CConfigField::Choice:
+                field.set(config, value->value);
+                break;
+        }
+    }
+    config.clients.clear();
+    for (size_t i = 0; i < header.clients; i++, value += 2)
+        config.clients.push_back(CClientEntry(value[0].value != 0,
+            std::string(strings + value[1].value, value[1].length)));
+    return true;
+}
+
+/// @brief Map and decode the cache of a file.
+static bool ReadCache(const std::string &path, CacheHeader &header, CConfig &config)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    bool ret = Decode((const char *)data, st.st_size, header, config);
+    munmap(data, st.st_size);
+    return ret;
+}
+
+static void WriteCache(const std::string &path, const struct stat &source, Hash source_hash,
+                       const CConfig &config)
+{
+    std::string content = Encode(config);
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.schema = SchemaHash();
+    header.fields = config_field_count;
+    header.clients = config.clients.size();
+    header.strings = content.size() - (header.fields + 2 * header.clients) * sizeof(CacheValue);
+    header.source_mtime = ModificationTime(source);
+    header.source_size = source.st_size;
+    header.source_hash = source_hash;
+    Hash hash = HASH_INIT;
+    HashData(hash, content.data(), content.size());
+    header.content_hash = hash;
+
+    // Written in full before it replaces the old one, so readers never see half of it
+    std::string dir = path.substr(0, path.rfind('/'));
+    mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0700);
+    mkdir(dir.c_str(), 0700);
+    std::string temp = path + ".XXXXXX";
+    int fd = mkstemp(&temp[0]);
+    if (fd < 0)
+        return;
+    bool ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+              write(fd, content.data(), content.size()) == (ssize_t)content.size();
+    if (close(fd) != 0 || !ok || rename(temp.c_str(), path.c_str()) != 0)
+        unlink(temp.c_str());
+}
+
+static bool ReadSource(const char *filename, std::string &data)
+{
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.append(buffer, len);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+bool LoadCompiledConfig(const char *filename, CConfig &config)
+{
+    CTraceScope trace("Load compiled configuration");
+    struct stat source;
+    std::string cache = filename[0] == '/' && stat(filename, &source) == 0 ? CachePath(filename) : "";
+
+    CacheHeader header;
+    CConfig cached;
+    bool valid = !cache.empty() && ReadCache(cache, header, cached) &&
+                 header.source_size == (uint64_t)source.st_size;
+    if (valid && header.source_mtime == ModificationTime(source))
+    {
+        config = cached;
+        return true;
+    }
+
+    std::string data;
+    if (!ReadSource(filename, data))
+        return false;
+    Hash hash = HASH_INIT;
+    HashData(hash, data.data(), data.size());
+
+    // Copied or synchronized files keep their contents but not their time
+    if (valid && header.source_hash == hash)
+    {
+        WriteCache(cache, source, hash, cached);
+        config = cached;
+        return true;
+    }
+
+    CConfig parsed(config);
+    try {
+        parsed.LoadFromMemory(data.data(), data.size());
+    } catch (std::runtime_error &)
+    {
+        return false;
+    }
+    if (!cache.empty())
+        WriteCache(cache, source, hash, parsed);
+    config = parsed;
+    return true;
+}
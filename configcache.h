@@ -0,0 +1,41 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __CONFIGCACHE_H__
+#define __CONFIGCACHE_H__
+
+#include "config.h"
+
+/// @brief Load a configuration file, through a compiled copy if possible.
+/// The first load parses the XML and stores the resulting configuration in
+/// a binary form in the user's cache directory. Later loads map that and
+/// skip the parser, as long as the file's size and modification time still
+/// match, or failing that the hash of its contents.
+/// @param filename Configuration file. Only absolute paths are cached, as
+/// the cache is keyed on the path.
+/// @param config Receives the configuration. It should hold the defaults,
+/// as a cached configuration replaces all of it.
+/// @return false if the file can't be read or parsed. config is unchanged then.
+bool LoadCompiledConfig(const char *filename, CConfig &config);
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#include <windows.h>
+#include <sddl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <vector>
+#include "daemon.h"
+#include "session.h"
+#include "configcache.h"
+#include "window/util.h"
+
+/* Size of the pipe buffers; longer messages are read in pieces */
+#define PIPE_BUFFER 4096
+/* How long a client waits for the daemon to finish the previous request, in ms */
+#define DAEMON_TIMEOUT 10000
+/* How long the daemon waits for a client to send its request or take the reply, in ms */
+#define REQUEST_TIMEOUT 5000
+
+/// @brief Get the user a process runs as.
+/// @param sid Receives the SID of the user.
+static bool ProcessUser(HANDLE process, std::vector<char> &sid)
+{
+    HANDLE token;
+    if (!OpenProcessToken(process, TOKEN_QUERY, &token))
+        return false;
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, NULL, 0, &size);
+    std::vector<char> user(size ? size : 1);
+    bool ok = size && GetTokenInformation(token, TokenUser, &user[0], size, &size);
+    CloseHandle(token);
+    if (!ok)
+        return false;
+    PSID usersid = ((TOKEN_USER *)&user[0])->User.Sid;
+    sid.assign((char *)usersid, (char *)usersid + GetLengthSid(usersid));
+    return true;
+}
+
+static std::vector<char> CurrentUser()
+{
+    std::vector<char> sid;
+    if (!ProcessUser(GetCurrentProcess(), sid))
+        throw win32_error("Can't get the current user");
+    return sid;
+}
+
+/// @brief Name of the pipe of the current user's daemon.
+/// Named after the SID of the user, so names of users in different
+/// domains can't collide.
+static std::string PipeName()
+{
+    std::vector<char> sid = CurrentUser();
+    char *str;
+    if (!ConvertSidToStringSid((PSID)&sid[0], &str))
+        throw win32_error("ConvertSidToStringSid failed");
+    std::string name = std::string("\\\\.\\pipe\\xlaunch-") + str;
+    LocalFree(str);
+    return name;
+}
+
+/// @brief Wait for an overlapped operation to finish.
+/// @param deadline Tick count at which to give up and cancel the operation.
+/// @return as ReadFile() or WriteFile() would without overlapping.
+static BOOL Finish(HANDLE pipe, OVERLAPPED &ov, BOOL ok, DWORD deadline, DWORD &count)
+{
+    if (!ok && GetLastError() == ERROR_IO_PENDING)
+    {
+        DWORD left = deadline - GetTickCount();
+        if ((LONG)left < 0)
+            left = 0;
+        if (WaitForSingleObject(ov.hEvent, left) != WAIT_OBJECT_0)
+        {
+            CancelIo(pipe);
+            GetOverlappedResult(pipe, &ov, &count, TRUE);
+            SetLastError(ERROR_TIMEOUT);
+            return FALSE;
+        }
+    }
+    else if (!ok && GetLastError() != ERROR_MORE_DATA)
+        return FALSE;
+    return GetOverlappedResult(pipe, &ov, &count, FALSE);
+}
+
+/// @brief Read a complete message from a pipe in message mode.
+/// @param ov For a pipe opened for overlapped I/O, the operation to use.
+/// The read is given up at the deadline then.
+static bool ReadMessage(HANDLE pipe, std::string &message, OVERLAPPED *ov = NULL, DWORD deadline = 0)
+{
+    char buffer[PIPE_BUFFER];
+    for (;;)
+    {
+        DWORD count = 0;
+        BOOL ok = ReadFile(pipe, buffer, sizeof(buffer), &count, ov);
+        if (ov)
+            ok = Finish(pipe, *ov, ok, deadline, count);
+        if (!ok && GetLastError() != ERROR_MORE_DATA)
+            return false;
+        message.append(buffer, count);
+        if (ok)
+            return true;
+    }
+}
+
+static bool WriteMessage(HANDLE pipe, const std::string &message, OVERLAPPED *ov = NULL, DWORD deadline = 0)
+{
+    DWORD count = 0;
+    BOOL ok = WriteFile(pipe, message.data(), message.size(), &count, ov);
+    if (ov)
+        ok = Finish(pipe, *ov, ok, deadline, count);
+    return ok && count == message.size();
+}
+
+CDaemon::CDaemon(const std::string &metricsfile) :
+    next_id(1), metricsfile(metricsfile)
+{
+}
+
+CDaemon::~CDaemon()
+{
+    std::map<unsigned, CSession *>::iterator i;
+    for (i = sessions.begin(); i != sessions.end(); ++i)
+        i->second->Stop();
+    for (i = sessions.begin(); i != sessions.end(); ++i)
+    {
+        i->second->Join();
+        delete i->second;
+    }
+}
+
+void CDaemon::Run()
+{
+    std::string name = PipeName();
+
+    // Only the current user may open the pipe
+    std::vector<char> sid = CurrentUser();
+    std::vector<char> acl(sizeof(ACL) + sizeof(ACCESS_ALLOWED_ACE) + sid.size());
+    SECURITY_DESCRIPTOR sd;
+    if (!InitializeAcl((PACL)&acl[0], acl.size(), ACL_REVISION) ||
+        !AddAccessAllowedAce((PACL)&acl[0], ACL_REVISION, GENERIC_ALL, (PSID)&sid[0]) ||
+        !InitializeSecurityDescriptor(&sd, SECURITY_DESCRIPTOR_REVISION) ||
+        !SetSecurityDescriptorDacl(&sd, TRUE, (PACL)&acl[0], FALSE))
+        throw win32_error("Can't set up the security of " + name);
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), &sd, FALSE };
+
+    HANDLE pipe = CreateNamedPipe(name.c_str(),
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_OVERLAPPED,
+        PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        1, PIPE_BUFFER, PIPE_BUFFER, 0, &sa);
+    if (pipe == INVALID_HANDLE_VALUE)
+        throw win32_error("Can't create " + name + ", is a daemon running already?");
+
+    // A client which doesn't send its request, or doesn't take the
+    // reply, is dropped after a while, so it can't hold up the others
+    OVERLAPPED ov;
+    ZeroMemory(&ov, sizeof(ov));
+    ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (ov.hEvent == NULL)
+    {
+        DWORD err = GetLastError();
+        CloseHandle(pipe);
+        throw win32_error("CreateEvent failed", err);
+    }
+
+    bool quit = false;
+    while (!quit)
+    {
+        DWORD count;
+        BOOL connected = ConnectNamedPipe(pipe, &ov);
+        if (!connected && GetLastError() == ERROR_IO_PENDING)
+            connected = GetOverlappedResult(pipe, &ov, &count, TRUE);
+        if (!connected && GetLastError() != ERROR_PIPE_CONNECTED)
+        {
+            DWORD err = GetLastError();
+            CloseHandle(ov.hEvent);
+            CloseHandle(pipe);
+            throw win32_error("ConnectNamedPipe failed", err);
+        }
+
+        std::string request;
+        if (ReadMessage(pipe, request, &ov, GetTickCount() + REQUEST_TIMEOUT))
+        {
+            std::string reply;
+            try {
+                reply = Handle(request, quit);
+            } catch (std::runtime_error &e)
+            {
+                reply = std::string("error ") + e.what() + "\n";
+            }
+            // Wait until the reply was taken, FlushFileBuffers() would wait
+            // on the client without a timeout
+            WriteMessage(pipe, reply, &ov, GetTickCount() + REQUEST_TIMEOUT);
+        }
+        DisconnectNamedPipe(pipe);
+    }
+    CloseHandle(ov.hEvent);
+    CloseHandle(pipe);
+}
+
+std::string CDaemon::Handle(const std::string &request, bool &quit)
+{
+    size_t eol = request.find('\n');
+    std::string line = request.substr(0, eol);
+    std::string command = line.substr(0, line.find(' '));
+    std::string args = command.size() < line.size() ? line.substr(command.size() + 1) : "";
+
+    if (debug)
+        printf("Request: %s\n", line.c_str());
+
+    if (command == "launch" && !args.empty())
+        return Launch(GetConfig(args), args);
+    else if (command == "launch")
+    {
+        if (eol == std::string::npos)
+            return "error No configuration given\n";
+        CConfig config;
+        config.LoadFromMemory(request.data() + eol + 1, request.size() - eol - 1);
+        return Launch(config, "(inline)");
+    }
+    else if (command == "stop")
+        return Stop(strtoul(args.c_str(), NULL, 10));
+    else if (command == "client")
+    {
+        char *program;
+        unsigned id = strtoul(args.c_str(), &program, 10);
+        while (*program == ' ')
+            program++;
+        return ReplaceClient(id, program);
+    }
+    else if (command == "status")
+        return Status();
+    else if (command == "quit")
+    {
+        quit = true;
+        return "ok\n";
+    }
+    return "error Unknown command " + command + "\n";
+}
+
+/// @brief Get a configuration, parsing the file only if it has changed.
+/// @throws std::runtime_error if the file can't be read or parsed.
+const CConfig &CDaemon::GetConfig(const std::string &filename)
+{
+    struct stat st;
+    if (filename[0] != '/')
+        throw std::runtime_error("Configuration path must be absolute: " + filename);
+    if (stat(filename.c_str(), &st) != 0)
+        throw std::runtime_error("Can't open " + filename);
+
+    // Edits within the same second which keep the size still change the time in ns
+    long long mtime = (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    std::map<std::string, CachedConfig>::iterator i = configs.find(filename);
+    if (i != configs.end() && i->second.device == st.st_dev && i->second.inode == st.st_ino &&
+        i->second.size == st.st_size && i->second.mtime == mtime)
+        return i->second.config;
+
+    CConfig config;
+    if (!LoadCompiledConfig(filename.c_str(), config))
+    {
+        if (i != configs.end())
+            configs.erase(i);
+        throw std::runtime_error("Can't load " + filename);
+    }
+    CachedConfig &cached = configs[filename];
+    cached.config = config;
+    cached.device = st.st_dev;
+    cached.inode = st.st_ino;
+    cached.size = st.st_size;
+    cached.mtime = mtime;
+    return cached.config;
+}
+
+std::string CDaemon::Launch(const CConfig &config, const std::string &name)
+{
+    Reap();
+    for (std::map<unsigned, CSession *>::iterator i = sessions.begin(); i != sessions.end(); ++i)
+        if (config.display != "auto" && i->second->Config().display == config.display)
+        {
+            char reply[128];
+            snprintf(reply, sizeof(reply), "error Display :%s is used by session %u\n",
+                     config.display.c_str(), i->first);
+            return reply;
+        }
+
+    CSession *session = new CSession(config, name, metricsfile, true);
+    try {
+        session->Start();
+    } catch (...)
+    {
+        delete session;
+        throw;
+    }
+    unsigned id = next_id++;
+    sessions[id] = session;
+
+    char reply[128];
+    snprintf(reply, sizeof(reply), "ok %u :%s\n", id, session->Config().display.c_str());
+    return reply;
+}
+
+std::string CDaemon::Stop(unsigned id)
+{
+    std::map<unsigned, CSession *>::iterator i = sessions.find(id);
+    if (i == sessions.end())
+        return "error No such session\n";
+    i->second->Stop();
+    return "ok\n";
+}
+
+std::string CDaemon::ReplaceClient(unsigned id, const std::string &program)
+{
+    std::map<unsigned, CSession *>::iterator i = sessions.find(id);
+    if (i == sessions.end())
+        return "error No such session\n";
+    if (!i->second->ReplaceClient(program))
+        return "error Session does not keep its server\n";
+    return "ok\n";
+}
+
+std::string CDaemon::Status()
+{
+    std::string reply = "ok\n";
+    for (std::map<unsigned, CSession *>::iterator i = sessions.begin(); i != sessions.end(); ++i)
+    {
+        CSession *session = i->second;
+        const char *state = "running";
+        if (session->Finished())
+            state = session->Failed() ? "failed" : "ended";
+        else if (session->Stopping())
+            state = "stopping";
+        char line[64];
+        snprintf(line, sizeof(line), "%u :%s %s ", i->first,
+                 session->Config().display.c_str(), state);
+        reply += line + session->Name() + "\n";
+    }
+    // Ended sessions have been reported once now
+    Reap();
+    return reply;
+}
+
+/// @brief Forget sessions which have ended.
+void CDaemon::Reap()
+{
+    std::map<unsigned, CSession *>::iterator i = sessions.begin();
+    while (i != sessions.end())
+    {
+        if (i->second->Finished())
+        {
+            delete i->second;
+            sessions.erase(i++);
+        }
+        else
+            ++i;
+    }
+}
+
+std::string SendToDaemon(const std::string &request)
+{
+    std::string name = PipeName();
+    HANDLE pipe;
+    for (;;)
+    {
+        pipe = CreateFile(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                          OPEN_EXISTING, 0, NULL);
+        if (pipe != INVALID_HANDLE_VALUE)
+            break;
+        if (GetLastError() != ERROR_PIPE_BUSY)
+            throw win32_error("Can't connect to " + name);
+        if (!WaitNamedPipe(name.c_str(), DAEMON_TIMEOUT))
+            throw win32_error("Timeout connecting to " + name);
+    }
+
+    // Anyone could have created a pipe of that name before the daemon, so
+    // make sure it is ours before handing over a configuration
+    ULONG pid;
+    HANDLE server = NULL;
+    std::vector<char> sid;
+    bool ours = GetNamedPipeServerProcessId(pipe, &pid) &&
+        (server = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid)) != NULL &&
+        ProcessUser(server, sid) && EqualSid((PSID)&sid[0], (PSID)&CurrentUser()[0]);
+    if (server)
+        CloseHandle(server);
+    if (!ours)
+    {
+        CloseHandle(pipe);
+        throw std::runtime_error(name + " is not served by a daemon of the current user");
+    }
+
+    DWORD mode = PIPE_READMODE_MESSAGE;
+    std::string reply;
+    bool ok = SetNamedPipeHandleState(pipe, &mode, NULL, NULL) &&
+        WriteMessage(pipe, request) && ReadMessage(pipe, reply);
+    DWORD err = GetLastError();
+    CloseHandle(pipe);
+    if (!ok)
+        throw win32_error("Request to daemon failed", err);
+    return reply;
+}
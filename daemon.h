@@ -0,0 +1,88 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __DAEMON_H__
+#define __DAEMON_H__
+
+#include <sys/types.h>
+#include <map>
+#include <string>
+#include "config.h"
+
+class CSession;
+
+/// @brief Broker running sessions on behalf of other processes.
+/// The daemon listens on a named pipe, named after the current user's SID,
+/// which only the current user's processes on this machine can open.
+/// Clients check that the pipe is served by a process of the same user.
+/// A client which doesn't send its request within a few seconds is dropped. Each request is a single message of which
+/// the first line holds the command:
+///   launch <file>  run the configuration in file, which must be absolute
+///   launch         run the configuration in the rest of the message
+///   stop <id>      stop a session
+///   client <id> [program]
+///                  restart the client of a session which keeps its server,
+///                  running program instead if given
+///   status         list sessions, one per line as: id display state name
+///   quit           stop all sessions and exit
+/// The reply starts with "ok" or "error" and a description.
+/// Configuration files are parsed once and kept until they change.
+class CDaemon
+{
+    private:
+        struct CachedConfig
+        {
+            dev_t device;
+            ino_t inode;
+            off_t size;
+            long long mtime;
+            CConfig config;
+        };
+        std::map<std::string, CachedConfig> configs;
+        std::map<unsigned, CSession *> sessions;
+        unsigned next_id;
+        std::string metricsfile;
+        const CConfig &GetConfig(const std::string &filename);
+        std::string Handle(const std::string &request, bool &quit);
+        std::string Launch(const CConfig &config, const std::string &name);
+        std::string Stop(unsigned id);
+        std::string ReplaceClient(unsigned id, const std::string &program);
+        std::string Status();
+        void Reap();
+    public:
+        /// @param metricsfile File to write resource usage to, or empty.
+        /// Each session writes its own, named after its display.
+        CDaemon(const std::string &metricsfile);
+        /// @brief Stop all sessions and wait until they have ended.
+        ~CDaemon();
+        /// @brief Serve requests until asked to quit.
+        /// @throws win32_error if another daemon is running.
+        void Run();
+};
+
+/// @brief Send a request to the daemon of the current user.
+/// @return The reply of the daemon.
+/// @throws win32_error if no daemon is running.
+std::string SendToDaemon(const std::string &request);
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include "envcache.h"
+#include "trace.h"
+
+extern char **environ;
+
+/*
+ * The cache file holds the key as a line, followed by the changes the login
+ * makes to the environment it is started with. Each change is a pair of
+ * NUL terminated strings, the variable after the login and before it, each
+ * as NAME=value, or as NAME alone if it is not set.
+ */
+#define ENV_CACHE_FILE ".xlaunch_env"
+#define ENV_CACHE_VERSION "2"
+
+/* Variables which belong to the shell or the launch, not the login */
+static const char *skipped[] = { "_", "SHLVL", "PWD", "OLDPWD", "DISPLAY" };
+
+typedef unsigned long long Hash;
+
+/// @brief Add data to a FNV-1a hash.
+static void HashData(Hash &hash, const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+/// @brief Add the name and contents of a file to the hash.
+/// A missing file counts too, so creating one invalidates the cache.
+static void HashFile(Hash &hash, const std::string &path)
+{
+    HashData(hash, path.c_str(), path.size() + 1);
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == NULL)
+        return;
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        HashData(hash, buffer, len);
+    fclose(f);
+}
+
+/// @brief Hash all files bash reads as a login shell.
+static std::string ProfileKey(const std::string &home)
+{
+    Hash hash = 0xcbf29ce484222325ULL;
+    HashFile(hash, "/etc/profile");
+    HashFile(hash, "/etc/bash.bashrc");
+
+    // /etc/profile sources these, sorted so the order is stable
+    std::vector<std::string> scripts;
+    DIR *dir = opendir("/etc/profile.d");
+    if (dir)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL)
+            if (entry->d_name[0] != '.')
+                scripts.push_back(std::string("/etc/profile.d/") + entry->d_name);
+        closedir(dir);
+    }
+    std::sort(scripts.begin(), scripts.end());
+    for (size_t i = 0; i < scripts.size(); i++)
+        HashFile(hash, scripts[i]);
+
+    static const char *profiles[] = { ".bash_profile", ".bash_login", ".profile", ".bashrc" };
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++)
+        HashFile(hash, home + "/" + profiles[i]);
+
+    char key[32];
+    snprintf(key, sizeof(key), ENV_CACHE_VERSION ":%016llx", hash);
+    return key;
+}
+
+/* Variables by name, with their values */
+typedef std::map<std::string, std::string> Variables;
+
+static bool Skipped(const std::string &name)
+{
+    for (size_t i = 0; i < sizeof(skipped) / sizeof(skipped[0]); i++)
+        if (name == skipped[i])
+            return true;
+    return false;
+}
+
+/// @brief Collect NAME=value entries, dropping the ones we set ourselves.
+static void AddVariable(Variables &vars, const char *entry)
+{
+    const char *eq = strchr(entry, '=');
+    if (eq == NULL || eq == entry)
+        return;
+    std::string name(entry, eq);
+    if (!Skipped(name))
+        vars[name] = eq + 1;
+}
+
+static void CurrentVariables(Variables &vars)
+{
+    for (char **entry = environ; *entry; entry++)
+        AddVariable(vars, *entry);
+}
+
+/// @brief Write a variable as NAME=value, or NAME if it is not set.
+static void AppendVariable(std::string &data, const Variables &vars, const std::string &name)
+{
+    data += name;
+    Variables::const_iterator i = vars.find(name);
+    if (i != vars.end())
+        data += "=" + i->second;
+    data += '\0';
+}
+
+/// @brief Describe the changes from one environment to another.
+static std::string Changes(const Variables &before, const Variables &after)
+{
+    std::string data;
+    for (Variables::const_iterator i = after.begin(); i != after.end(); ++i)
+    {
+        Variables::const_iterator old = before.find(i->first);
+        if (old == before.end() || old->second != i->second)
+        {
+            AppendVariable(data, after, i->first);
+            AppendVariable(data, before, i->first);
+        }
+    }
+    for (Variables::const_iterator i = before.begin(); i != before.end(); ++i)
+        if (after.find(i->first) == after.end())
+        {
+            AppendVariable(data, after, i->first);
+            AppendVariable(data, before, i->first);
+        }
+    return data;
+}
+
+/// @brief Apply changes to an environment.
+/// @return false if a changed variable doesn't have the value it had when
+/// the changes were captured, as they may depend on it.
+static bool ApplyChanges(const std::string &data, Variables &vars)
+{
+    Variables current(vars);
+    size_t pos = 0, end;
+    while ((end = data.find('\0', pos)) != std::string::npos)
+    {
+        std::string after = data.substr(pos, end - pos);
+        pos = end + 1;
+        if ((end = data.find('\0', pos)) == std::string::npos)
+            return false;
+        std::string before = data.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t eq = before.find('=');
+        std::string name = before.substr(0, eq);
+        Variables::iterator i = current.find(name);
+        if ((i == current.end()) != (eq == std::string::npos) ||
+            (i != current.end() && i->second != before.substr(eq + 1)))
+            return false;
+
+        eq = after.find('=');
+        if (eq == std::string::npos)
+            vars.erase(name);
+        else
+            vars[name] = after.substr(eq + 1);
+    }
+    return true;
+}
+
+static bool ReadAll(FILE *f, std::string &data)
+{
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.append(buffer, len);
+    return !ferror(f);
+}
+
+/// @brief Read the cache, if it was written for the same profile files.
+static bool ReadCache(const std::string &path, const std::string &key, std::string &data)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == NULL)
+        return false;
+    bool ok = ReadAll(f, data);
+    fclose(f);
+    if (!ok || data.compare(0, key.size() + 1, key + "\n") != 0)
+        return false;
+    data.erase(0, key.size() + 1);
+    return true;
+}
+
+static void WriteCache(const std::string &path, const std::string &key, const std::string &data)
+{
+    // Sessions starting together may all capture, so each writes its own
+    std::string temp = path + ".XXXXXX";
+    int fd = mkstemp(&temp[0]);
+    if (fd < 0)
+        return;
+    FILE *f = fdopen(fd, "wb");
+    if (f == NULL)
+    {
+        close(fd);
+        remove(temp.c_str());
+        return;
+    }
+    fprintf(f, "%s\n", key.c_str());
+    fwrite(data.data(), 1, data.size(), f);
+    if (fclose(f) == 0)
+        rename(temp.c_str(), path.c_str());
+    else
+        remove(temp.c_str());
+}
+
+/* Printed between the output of the profile scripts and the environment.
+   As it has no '=', no entry can be mistaken for it. */
+#define ENV_MARKER "XLAUNCH-ENVIRONMENT"
+
+/// @brief Run the login shell and collect what it exports.
+static bool Capture(std::string &data)
+{
+    CTraceScope trace("Capture login environment");
+    FILE *f = popen("bash -l -c 'printf \"\\0%s\\0\" " ENV_MARKER "; env -0' </dev/null", "r");
+    if (f == NULL)
+        return false;
+    bool ok = ReadAll(f, data);
+    if (pclose(f) != 0 || !ok)
+        return false;
+    // Whatever the profile scripts printed comes before the marker
+    static const char marker[] = "\0" ENV_MARKER;
+    size_t pos = data.rfind(std::string(marker, sizeof(marker) - 1) + '\0');
+    if (pos == std::string::npos)
+        return false;
+    data.erase(0, pos + sizeof(marker));
+    return !data.empty();
+}
+
+bool LoginEnvironment(std::vector<std::string> &env)
+{
+    const char *home = getenv("HOME");
+    if (home == NULL || *home == 0)
+        return false;
+    std::string path = std::string(home) + "/" ENV_CACHE_FILE;
+    std::string key = ProfileKey(home);
+
+    Variables vars;
+    CurrentVariables(vars);
+    std::string changes;
+    if (!ReadCache(path, key, changes) || !ApplyChanges(changes, vars))
+    {
+        std::string data;
+        if (!Capture(data))
+            return false;
+        Variables login;
+        for (size_t pos = 0; pos < data.size(); pos += strlen(&data[pos]) + 1)
+            AddVariable(login, &data[pos]);
+        if (login.empty())
+            return false;
+        vars.clear();
+        CurrentVariables(vars);
+        changes = Changes(vars, login);
+        WriteCache(path, key, changes);
+        vars.swap(login);
+    }
+
+    // The variables we don't take from the login are passed on as they are
+    for (char **entry = environ; *entry; entry++)
+    {
+        const char *eq = strchr(*entry, '=');
+        std::string name(*entry, eq ? eq - *entry : 0);
+        if (eq && Skipped(name) && name != "DISPLAY")
+            env.push_back(*entry);
+    }
+    for (Variables::iterator i = vars.begin(); i != vars.end(); ++i)
+        env.push_back(i->first + "=" + i->second);
+    return true;
+}
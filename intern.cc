@@ -0,0 +1,168 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include "intern.h"
+
+struct CInternedString::Entry
+{
+    Entry *next;
+    size_t hash;
+    volatile long refs;     /// Only drops to 0 with the table locked.
+    std::string text;
+};
+
+/* The table is plain data, so it is usable before static constructors ran */
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CInternedString::Entry **buckets;
+static size_t bucket_count;
+static size_t entry_count;
+
+static size_t Hash(const char *str, size_t length)
+{
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+    return hash;
+}
+
+/// @brief Spread the entries over twice as many buckets.
+static void Grow()
+{
+    size_t count = bucket_count ? bucket_count * 2 : 64;
+    CInternedString::Entry **grown = new CInternedString::Entry *[count]();
+    for (size_t i = 0; i < bucket_count; i++)
+        while (buckets[i])
+        {
+            CInternedString::Entry *entry = buckets[i];
+            buckets[i] = entry->next;
+            entry->next = grown[entry->hash & (count - 1)];
+            grown[entry->hash & (count - 1)] = entry;
+        }
+    delete[] buckets;
+    buckets = grown;
+    bucket_count = count;
+}
+
+CInternedString::Entry *CInternedString::Intern(const char *str, size_t length)
+{
+    if (length == 0)
+        return NULL;
+    size_t hash = Hash(str, length);
+
+    pthread_mutex_lock(&table_mutex);
+    if (entry_count >= bucket_count)
+        Grow();
+    Entry **bucket = &buckets[hash & (bucket_count - 1)];
+    Entry *entry;
+    for (entry = *bucket; entry; entry = entry->next)
+        if (entry->hash == hash && entry->text.size() == length &&
+            memcmp(entry->text.data(), str, length) == 0)
+            break;
+    if (entry)
+        __sync_fetch_and_add(&entry->refs, 1);
+    else
+    {
+        entry = new Entry;
+        entry->hash = hash;
+        entry->refs = 1;
+        entry->text.assign(str, length);
+        entry->next = *bucket;
+        *bucket = entry;
+        entry_count++;
+    }
+    pthread_mutex_unlock(&table_mutex);
+    return entry;
+}
+
+void CInternedString::Acquire(Entry *entry)
+{
+    // The caller holds a reference, so the entry can't go away meanwhile
+    if (entry)
+        __sync_fetch_and_add(&entry->refs, 1);
+}
+
+void CInternedString::Release(Entry *entry)
+{
+    if (entry == NULL)
+        return;
+    // Dropping a reference which is not the last one needs no lock
+    for (;;)
+    {
+        long refs = __atomic_load_n(&entry->refs, __ATOMIC_RELAXED);
+        if (refs <= 1)
+            break;
+        if (__sync_bool_compare_and_swap(&entry->refs, refs, refs - 1))
+            return;
+    }
+
+    // Intern() may find the entry again until it is unlinked
+    pthread_mutex_lock(&table_mutex);
+    if (__sync_sub_and_fetch(&entry->refs, 1) == 0)
+    {
+        Entry **link = &buckets[entry->hash & (bucket_count - 1)];
+        while (*link != entry)
+            link = &(*link)->next;
+        *link = entry->next;
+        entry_count--;
+        delete entry;
+    }
+    pthread_mutex_unlock(&table_mutex);
+}
+
+CInternedString::CInternedString(const char *str) :
+    entry(Intern(str, strlen(str)))
+{
+}
+
+CInternedString &CInternedString::operator=(const CInternedString &other)
+{
+    Acquire(other.entry);
+    Release(entry);
+    entry = other.entry;
+    return *this;
+}
+
+CInternedString &CInternedString::assign(const char *str, size_t length)
+{
+    Entry *previous = entry;
+    entry = Intern(str, length);
+    Release(previous);
+    return *this;
+}
+
+const std::string &CInternedString::str() const
+{
+    static const std::string empty;
+    return entry ? entry->text : empty;
+}
+
+size_t CInternedString::Count()
+{
+    pthread_mutex_lock(&table_mutex);
+    size_t count = entry_count;
+    pthread_mutex_unlock(&table_mutex);
+    return count;
+}
@@ -0,0 +1,68 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __INTERN_H__
+#define __INTERN_H__
+
+#include <string>
+
+/// @brief An immutable string shared with every equal string.
+/// The text is kept once in a table for all threads, with a count of its
+/// users. Copying only adds to the count, and equal strings compare by
+/// pointer. The empty string has no entry.
+class CInternedString
+{
+    public:
+        struct Entry;
+    private:
+        Entry *entry;
+        static Entry *Intern(const char *str, size_t length);
+        static void Acquire(Entry *entry);
+        static void Release(Entry *entry);
+    public:
+        CInternedString() : entry(NULL) {}
+        CInternedString(const std::string &str) : entry(Intern(str.data(), str.size())) {}
+        CInternedString(const char *str);
+        CInternedString(const CInternedString &other) : entry(other.entry) { Acquire(entry); }
+        ~CInternedString() { Release(entry); }
+        CInternedString &operator=(const CInternedString &other);
+        CInternedString &assign(const char *str, size_t length);
+        /// @brief The text, valid for as long as this string is not changed.
+        const std::string &str() const;
+        operator const std::string &() const { return str(); }
+        const char *c_str() const { return str().c_str(); }
+        size_t size() const { return str().size(); }
+        bool empty() const { return entry == NULL; }
+        bool operator==(const CInternedString &other) const { return entry == other.entry; }
+        bool operator!=(const CInternedString &other) const { return entry != other.entry; }
+        bool operator==(const char *other) const { return str() == other; }
+        bool operator!=(const char *other) const { return str() != other; }
+        /// @brief Number of distinct strings held, for diagnostics.
+        static size_t Count();
+};
+
+inline std::string operator+(const CInternedString &a, const char *b) { return a.str() + b; }
+inline std::string operator+(const char *a, const CInternedString &b) { return a + b.str(); }
+inline std::string operator+(const std::string &a, const CInternedString &b) { return a + b.str(); }
+
+#endif
@@ -0,0 +1,506 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include "launchspawn.h"
+#ifdef SPAWN_WIN32
+#include "window/util.h"
+#ifdef __CYGWIN__
+#include <sys/cygwin.h>
+#endif
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <spawn.h>
+extern char **environ;
+#endif
+
+/// @brief Quote an argument, unless it needs none.
+/// Backslashes are only special in front of a double quote.
+static std::string QuoteArgument(const std::string &arg)
+{
+    // A Cygwin program would take a single quote as quoting too
+    if (!arg.empty() && arg.find_first_of(" \t\n\v\"'") == std::string::npos)
+        return arg;
+
+    std::string ret = "\"";
+    for (std::string::const_iterator i = arg.begin(); ; ++i)
+    {
+        unsigned backslashes = 0;
+        while (i != arg.end() && *i == '\\')
+        {
+            ++i;
+            ++backslashes;
+        }
+        if (i == arg.end())
+        {
+            // Escape them all, so the closing quote stays one
+            ret.append(backslashes * 2, '\\');
+            break;
+        }
+        if (*i == '"')
+            ret.append(backslashes * 2 + 1, '\\');
+        else
+            ret.append(backslashes, '\\');
+        ret += *i;
+    }
+    ret += "\"";
+    return ret;
+}
+
+std::string JoinCommandLine(const std::vector<std::string> &argv)
+{
+    std::string ret;
+    for (size_t i = 0; i < argv.size(); i++)
+    {
+        if (i)
+            ret += " ";
+        ret += QuoteArgument(argv[i]);
+    }
+    return ret;
+}
+
+void SplitCommandLine(const std::string &cmdline, std::vector<std::string> &argv)
+{
+    std::string arg;
+    bool inarg = false;
+    bool quoted = false;
+    for (size_t i = 0; i < cmdline.size(); i++)
+    {
+        char c = cmdline[i];
+        if (!quoted && strchr(" \t\n\v", c))
+        {
+            if (inarg)
+                argv.push_back(arg);
+            arg.clear();
+            inarg = false;
+            continue;
+        }
+        inarg = true;
+        if (c == '\\')
+        {
+            size_t end = cmdline.find_first_not_of('\\', i);
+            if (end == std::string::npos)
+                end = cmdline.size();
+            size_t backslashes = end - i;
+            if (end < cmdline.size() && cmdline[end] == '"')
+            {
+                // 2n backslashes and a quote are n backslashes and a quote
+                // character; 2n+1 are n backslashes and a literal quote
+                arg.append(backslashes / 2, '\\');
+                if (backslashes % 2)
+                    arg += '"';
+                else
+                    quoted = !quoted;
+                i = end;
+            }
+            else
+            {
+                arg.append(backslashes, '\\');
+                i = end - 1;
+            }
+        }
+        else if (c == '"')
+            quoted = !quoted;
+        else
+            arg += c;
+    }
+    if (inarg)
+        argv.push_back(arg);
+}
+
+bool SplitArguments(const std::string &cmdline, std::vector<std::string> &argv)
+{
+    std::string arg;
+    bool inarg = false;
+    char quote = 0;
+    for (size_t i = 0; i < cmdline.size(); i++)
+    {
+        char c = cmdline[i];
+        if (quote == '\'')
+        {
+            if (c == '\'')
+                quote = 0;
+            else
+                arg += c;
+        }
+        else if (c == '\\' && i + 1 < cmdline.size() &&
+                 (cmdline[i + 1] == '"' || (!quote && cmdline[i + 1] == '\'')))
+            arg += cmdline[++i];
+        else if (quote == '"')
+        {
+            if (c == '"')
+                quote = 0;
+            else
+                arg += c;
+        }
+        else if (strchr(" \t\n\v", c))
+        {
+            if (inarg)
+                argv.push_back(arg);
+            arg.clear();
+            inarg = false;
+        }
+        else
+        {
+            inarg = true;
+            if (c == '"' || c == '\'')
+                quote = c;
+            else
+                arg += c;
+        }
+    }
+    if (inarg)
+        argv.push_back(arg);
+    return quote == 0;
+}
+
+std::string JoinShellCommand(const std::vector<std::string> &argv)
+{
+    std::string ret;
+    for (size_t i = 0; i < argv.size(); i++)
+    {
+        if (i)
+            ret += " ";
+        ret += "'";
+        for (size_t c = 0; c < argv[i].size(); c++)
+        {
+            if (argv[i][c] == '\'')
+                ret += "'\\''";
+            else
+                ret += argv[i][c];
+        }
+        ret += "'";
+    }
+    return ret;
+}
+
+bool SplitPlainCommand(const std::string &command, std::vector<std::string> &argv)
+{
+    static const char plain[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+                                " \t-_./:,+@%=";
+    if (command.find_first_not_of(plain) != std::string::npos)
+        return false;
+
+    std::vector<std::string> words;
+    size_t start = command.find_first_not_of(" \t");
+    while (start != std::string::npos)
+    {
+        size_t end = command.find_first_of(" \t", start);
+        words.push_back(command.substr(start, end == std::string::npos ? end : end - start));
+        start = command.find_first_not_of(" \t", end);
+    }
+    // A leading NAME=value is an assignment
+    if (words.empty() || words[0].find('=') != std::string::npos)
+        return false;
+    argv.swap(words);
+    return true;
+}
+
+/// @brief Check that Spawn can start a file without a shell.
+static bool Runnable(const std::string &file)
+{
+    if (access(file.c_str(), X_OK) != 0)
+        return false;
+#ifdef SPAWN_WIN32
+    // CreateProcess only runs executables, not #! scripts
+    FILE *f = fopen(file.c_str(), "rb");
+    if (f == NULL)
+        return false;
+    char magic[2];
+    bool exe = fread(magic, 1, 2, f) == 2 && magic[0] == 'M' && magic[1] == 'Z';
+    fclose(f);
+    return exe;
+#else
+    return true;
+#endif
+}
+
+/// @brief Programs found by FindProgram, keyed on PATH and name.
+class CProgramCache
+{
+    public:
+        struct Entry
+        {
+            std::string file;   /// Where it was found.
+            std::string spawn;  /// The form Spawn needs.
+        };
+        CProgramCache()
+        {
+#ifdef SPAWN_WIN32
+            InitializeCriticalSection(&mutex);
+#else
+            pthread_mutex_init(&mutex, NULL);
+#endif
+        }
+        void Lock()
+        {
+#ifdef SPAWN_WIN32
+            EnterCriticalSection(&mutex);
+#else
+            pthread_mutex_lock(&mutex);
+#endif
+        }
+        void Unlock()
+        {
+#ifdef SPAWN_WIN32
+            LeaveCriticalSection(&mutex);
+#else
+            pthread_mutex_unlock(&mutex);
+#endif
+        }
+        std::map<std::string, Entry> entries;
+    private:
+#ifdef SPAWN_WIN32
+        CRITICAL_SECTION mutex;
+#else
+        pthread_mutex_t mutex;
+#endif
+};
+
+static CProgramCache program_cache;
+
+bool FindProgram(const std::string &name, const std::string &path, std::string &found)
+{
+    if (name.empty() || name.find('/') != std::string::npos)
+        return false;
+
+    std::string key = path + '\0' + name;
+    program_cache.Lock();
+    std::map<std::string, CProgramCache::Entry>::iterator i = program_cache.entries.find(key);
+    CProgramCache::Entry entry;
+    bool cached = i != program_cache.entries.end();
+    if (cached)
+        entry = i->second;
+    program_cache.Unlock();
+
+    // A program found before is most likely still there
+    if (cached && access(entry.file.c_str(), X_OK) == 0)
+    {
+        found = entry.spawn;
+        return true;
+    }
+
+    entry.file.clear();
+    size_t start = 0;
+    for (;;)
+    {
+        size_t end = path.find(':', start);
+        std::string dir = path.substr(start, end == std::string::npos ? end : end - start);
+        // Relative entries would depend on where xlaunch happens to run
+        if (!dir.empty() && dir[0] == '/' && Runnable(dir + "/" + name))
+        {
+            entry.file = dir + "/" + name;
+            break;
+        }
+        if (end == std::string::npos)
+            break;
+        start = end + 1;
+    }
+    if (entry.file.empty())
+        return false;
+
+    entry.spawn = entry.file;
+#ifdef __CYGWIN__
+    // Windows doesn't know about Cygwin symlinks
+    char resolved[PATH_MAX];
+    if (realpath(entry.file.c_str(), resolved) == NULL)
+        return false;
+    char native[MAX_PATH];
+    if (cygwin_conv_path(CCP_POSIX_TO_WIN_A | CCP_ABSOLUTE, resolved, native, sizeof(native)) != 0)
+        return false;
+    entry.spawn = native;
+#endif
+
+    program_cache.Lock();
+    program_cache.entries[key] = entry;
+    program_cache.Unlock();
+    found = entry.spawn;
+    return true;
+}
+
+#ifdef SPAWN_WIN32
+
+#ifdef __CYGWIN__
+/// @brief Convert an entry to the form the Cygwin runtime expects from a
+/// Windows parent, which converts these variables back to POSIX paths.
+static std::string NativeEntry(const std::string &entry)
+{
+    static const char *paths[] = { "HOME", "TMPDIR", "TMP", "TEMP" };
+    size_t eq = entry.find('=');
+    if (eq == std::string::npos)
+        return entry;
+    std::string name = entry.substr(0, eq);
+    const char *value = entry.c_str() + eq + 1;
+
+    cygwin_conv_path_t what;
+    if (name == "PATH" || name == "LD_LIBRARY_PATH")
+        what = CCP_POSIX_TO_WIN_A;
+    else if (std::find(paths, paths + 4, name) != paths + 4)
+        what = CCP_POSIX_TO_WIN_A | CCP_ABSOLUTE;
+    else
+        return entry;
+
+    bool list = name[0] == 'P' || name[0] == 'L';
+    ssize_t size = list ? cygwin_conv_path_list(what, value, NULL, 0)
+                        : cygwin_conv_path(what, value, NULL, 0);
+    if (size <= 0)
+        return entry;
+    std::vector<char> native(size);
+    if ((list ? cygwin_conv_path_list(what, value, &native[0], size)
+              : cygwin_conv_path(what, value, &native[0], size)) != 0)
+        return entry;
+    return name + "=" + &native[0];
+}
+#else
+#define NativeEntry(entry) (entry)
+#endif
+
+void Spawn(const SpawnRequest &request, SpawnedProcess &process)
+{
+    if (request.argv.empty())
+        throw std::runtime_error("Spawn: no program given");
+
+    std::string cmdline = JoinCommandLine(request.argv);
+
+    // Environment block: NAME=value strings, terminated by an empty one
+    std::string env;
+    for (size_t i = 0; i < request.env.size(); i++)
+    {
+        env += NativeEntry(request.env[i]);
+        env += '\0';
+    }
+    env += '\0';
+
+    STARTUPINFOEX si;
+    ZeroMemory(&si, sizeof(si));
+    si.StartupInfo.cb = sizeof(si);
+    if (!request.show)
+    {
+        si.StartupInfo.dwFlags = STARTF_USESHOWWINDOW;
+        si.StartupInfo.wShowWindow = SW_HIDE;
+    }
+    DWORD flags = request.suspended ? CREATE_SUSPENDED : 0;
+
+    // Only the standard handles are inherited, not everything of ours which
+    // is inheritable at the time, like the -displayfd pipe of another session
+    BOOL inherit = FALSE;
+    std::vector<char> attributes;
+    LPPROC_THREAD_ATTRIBUTE_LIST list = NULL;
+    if (request.stdio[0] || request.stdio[1] || request.stdio[2])
+    {
+        static const DWORD std_ids[3] = { STD_INPUT_HANDLE, STD_OUTPUT_HANDLE, STD_ERROR_HANDLE };
+        HANDLE *std_handles[3] = { &si.StartupInfo.hStdInput, &si.StartupInfo.hStdOutput,
+                                   &si.StartupInfo.hStdError };
+        HANDLE inherited[3];
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            HANDLE handle = request.stdio[i];
+            if (!handle)
+            {
+                // Ours must be inheritable to be in the list
+                handle = GetStdHandle(std_ids[i]);
+                if (handle && handle != INVALID_HANDLE_VALUE)
+                    SetHandleInformation(handle, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+            }
+            *std_handles[i] = handle;
+            // The list may name a handle only once
+            if (handle && handle != INVALID_HANDLE_VALUE &&
+                std::find(inherited, inherited + count, handle) == inherited + count)
+                inherited[count++] = handle;
+        }
+        si.StartupInfo.dwFlags |= STARTF_USESTDHANDLES;
+
+        if (count)
+        {
+            SIZE_T size = 0;
+            InitializeProcThreadAttributeList(NULL, 1, 0, &size);
+            attributes.resize(size);
+            list = (LPPROC_THREAD_ATTRIBUTE_LIST)&attributes[0];
+            if (!InitializeProcThreadAttributeList(list, 1, 0, &size))
+                throw win32_error("InitializeProcThreadAttributeList failed");
+            if (!UpdateProcThreadAttribute(list, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                                           inherited, count * sizeof(HANDLE), NULL, NULL))
+            {
+                DWORD err = GetLastError();
+                DeleteProcThreadAttributeList(list);
+                throw win32_error("UpdateProcThreadAttribute failed", err);
+            }
+            si.lpAttributeList = list;
+            flags |= EXTENDED_STARTUPINFO_PRESENT;
+            inherit = TRUE;
+        }
+    }
+
+    ZeroMemory(&process, sizeof(process));
+    BOOL created = CreateProcess(NULL, &cmdline[0], NULL, NULL, inherit, flags,
+                                 request.env.empty() ? NULL : &env[0], NULL,
+                                 &si.StartupInfo, &process);
+    DWORD err = GetLastError();
+    if (list)
+        DeleteProcThreadAttributeList(list);
+    if (!created)
+        throw win32_error("CreateProcess failed", err);
+}
+
+#else
+
+void Spawn(const SpawnRequest &request, SpawnedProcess &process)
+{
+    if (request.argv.empty())
+        throw std::runtime_error("Spawn: no program given");
+
+    std::vector<char *> argv;
+    for (size_t i = 0; i < request.argv.size(); i++)
+        argv.push_back(const_cast<char *>(request.argv[i].c_str()));
+    argv.push_back(NULL);
+
+    std::vector<char *> envp;
+    for (size_t i = 0; i < request.env.size(); i++)
+        envp.push_back(const_cast<char *>(request.env[i].c_str()));
+    envp.push_back(NULL);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    for (int i = 0; i < 3; i++)
+        if (request.stdio[i] != SPAWN_INHERIT)
+            posix_spawn_file_actions_adddup2(&actions, request.stdio[i], i);
+
+    // posix_spawn uses vfork semantics where available
+    int err = posix_spawnp(&process, argv[0], &actions, NULL, &argv[0],
+                           request.env.empty() ? environ : &envp[0]);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err)
+        throw std::runtime_error(std::string("posix_spawn failed: ") + strerror(err));
+}
+
+#endif
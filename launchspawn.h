@@ -0,0 +1,99 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __LAUNCHSPAWN_H__
+#define __LAUNCHSPAWN_H__
+
+#include <string>
+#include <vector>
+
+#if defined (__CYGWIN__) || defined (__MINGW__) || defined (_WIN32)
+#define SPAWN_WIN32
+#include <windows.h>
+typedef HANDLE SpawnHandle;
+typedef PROCESS_INFORMATION SpawnedProcess;
+#define SPAWN_INHERIT NULL
+#else
+#include <sys/types.h>
+typedef int SpawnHandle;
+typedef pid_t SpawnedProcess;
+#define SPAWN_INHERIT (-1)
+#endif
+
+/// @brief Description of a process to start.
+struct SpawnRequest
+{
+    std::vector<std::string> argv;  /// Program and arguments. The program is searched in PATH.
+    std::vector<std::string> env;   /// NAME=value entries in POSIX form, or empty to inherit ours.
+    SpawnHandle stdio[3];           /// stdin, stdout and stderr, or SPAWN_INHERIT.
+    bool show;                      /// Show the console window of the process.
+    bool suspended;                 /// Don't run the main thread until resumed (Win32 only).
+    SpawnRequest() : show(true), suspended(false)
+    {
+        stdio[0] = stdio[1] = stdio[2] = SPAWN_INHERIT;
+    }
+};
+
+/// @brief Start a process.
+/// Uses CreateProcess on Windows and posix_spawnp elsewhere. On Windows
+/// the process inherits only the handles in stdio, if any.
+/// @throws win32_error or std::runtime_error if the process can't be started.
+void Spawn(const SpawnRequest &request, SpawnedProcess &process);
+
+/// @brief Join arguments into a command line, quoted as Windows programs
+/// and the Cygwin runtime split it again.
+std::string JoinCommandLine(const std::vector<std::string> &argv);
+
+/// @brief Split a command line into arguments.
+/// Arguments are separated by whitespace and may be quoted with double quotes.
+void SplitCommandLine(const std::string &cmdline, std::vector<std::string> &argv);
+
+/// @brief Split extra arguments from a configuration, eg. ExtraParams.
+/// The rules are those the Cygwin runtime used for them while they were
+/// still passed on in a command line: arguments are separated by
+/// whitespace, single quotes quote everything up to the next one, and
+/// double quotes quote with \" as a literal quote. Other backslashes are
+/// kept, so Windows paths need no quoting.
+/// @return false if a quote is not closed. The arguments are split anyway.
+bool SplitArguments(const std::string &cmdline, std::vector<std::string> &argv);
+
+/// @brief Join arguments into a command for a POSIX shell.
+/// Every argument is single quoted, so the shell expands nothing in it.
+std::string JoinShellCommand(const std::vector<std::string> &argv);
+
+/// @brief Split a shell command which needs no shell to run.
+/// That is one made of plain words only, without quoting, expansions,
+/// redirections, variable assignments or anything else the shell acts on.
+/// @return false if the command needs a shell.
+bool SplitPlainCommand(const std::string &command, std::vector<std::string> &argv);
+
+/// @brief Search a program in a PATH list, like the shell would.
+/// Only programs Spawn can start directly are found, so on Windows scripts
+/// are not. Results are cached per PATH and checked again on use.
+/// @param name Program name. Names with a slash are not searched.
+/// @param path Colon separated list of directories, in POSIX form.
+/// @param found Receives the program in the form Spawn needs it.
+/// @return false if no such program was found.
+bool FindProgram(const std::string &name, const std::string &path, std::string &found);
+
+#endif
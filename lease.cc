@@ -0,0 +1,213 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <set>
+
+#include "lease.h"
+
+#define X_LOCK_DIR "/tmp"
+#define X_UNIX_DIR "/tmp/.X11-unix"
+
+/// @brief Check if a process exists, possibly owned by someone else.
+static bool Alive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+/// @brief Collect the display numbers of entries named prefix<n>suffix.
+static void ScanDirectory(const char *dir, const char *prefix, const char *suffix,
+                          std::set<unsigned> &numbers)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return;
+    size_t plen = strlen(prefix);
+    while (struct dirent *entry = readdir(d))
+    {
+        const char *name = entry->d_name;
+        if (strncmp(name, prefix, plen) != 0)
+            continue;
+        char *end;
+        unsigned long number = strtoul(name + plen, &end, 10);
+        if (end != name + plen && strcmp(end, suffix) == 0)
+            numbers.insert(number);
+    }
+    closedir(d);
+}
+
+/// @brief Check the lock file of a display, removing it if its server is gone.
+/// @return true if the display is in use.
+static bool LockInUse(unsigned display)
+{
+    char path[64];
+    snprintf(path, sizeof(path), X_LOCK_DIR "/.X%u-lock", display);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return errno != ENOENT;
+    // The server writes its pid as ten characters
+    char buffer[16];
+    size_t size = fread(buffer, 1, sizeof(buffer) - 1, f);
+    fclose(f);
+    buffer[size] = 0;
+    // A server may not have written it yet
+    pid_t pid = atoi(buffer);
+    if (size < 10 || Alive(pid))
+        return true;
+    return unlink(path) != 0 && errno != ENOENT;
+}
+
+/// @brief Check the socket of a display, removing it if nobody listens.
+/// @return true if the display is in use.
+static bool SocketInUse(unsigned display)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), X_UNIX_DIR "/X%u", display);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return true;
+    int ret = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    int err = errno;
+    close(fd);
+    if (ret == 0)
+        return true;
+    if (err == ENOENT)
+        return false;
+    if (err != ECONNREFUSED)
+        return true;
+    return unlink(addr.sun_path) != 0 && errno != ENOENT;
+}
+
+/// @brief Check that the lease directory is shared safely, creating it if needed.
+/// It must be a real directory everybody can create files in, with the
+/// sticky bit so nobody can remove or replace the leases of others.
+static bool LeaseDirectory()
+{
+    if (mkdir(LEASE_DIR, 01777) == 0)
+    {
+        // The umask applies to mkdir
+        if (chmod(LEASE_DIR, 01777) != 0)
+            return false;
+    }
+    else if (errno != EEXIST)
+        return false;
+    struct stat st;
+    if (lstat(LEASE_DIR, &st) != 0 || !S_ISDIR(st.st_mode))
+        return false;
+    if ((st.st_mode & 01777) == 01777)
+        return true;
+    return st.st_uid == geteuid() && chmod(LEASE_DIR, 01777) == 0;
+}
+
+/// @brief Try to take the lease of a display.
+/// A lease is held by whoever holds the lock of the file named after the
+/// display, so the lease of a process which is gone is free again. Lease
+/// files are only removed by their holder, while still holding the lock,
+/// and the lock only counts if the file was still there once it was taken.
+/// @return The locked file, or -1 if somebody else holds the lease.
+static int ClaimLease(unsigned display)
+{
+    char path[64];
+    snprintf(path, sizeof(path), LEASE_DIR "/%u", display);
+    for (;;)
+    {
+        // Don't follow links nor block on fifos planted by somebody else
+        int fd = open(path, O_RDONLY | O_CREAT | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return -1;
+        struct stat st, current;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || flock(fd, LOCK_EX | LOCK_NB) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        if (lstat(path, &current) == 0 && current.st_dev == st.st_dev && current.st_ino == st.st_ino)
+            return fd;
+        // Released and removed while we were opening it
+        close(fd);
+    }
+}
+
+/// @brief Give a lease back.
+static void ReleaseLease(unsigned display, int fd)
+{
+    char path[64];
+    snprintf(path, sizeof(path), LEASE_DIR "/%u", display);
+    // A file of somebody else who had left it behind stays, unlocked
+    unlink(path);
+    close(fd);
+}
+
+unsigned CDisplayLease::Acquire(unsigned first)
+{
+    Release();
+    // Without the lease directory only the servers already running are avoided
+    bool leases = LeaseDirectory();
+
+    // Look at the directories once instead of probing every number
+    std::set<unsigned> locks, sockets;
+    ScanDirectory(X_LOCK_DIR, ".X", "-lock", locks);
+    ScanDirectory(X_UNIX_DIR, "X", "", sockets);
+
+    for (unsigned display = first;; display++)
+    {
+        if (locks.count(display) && LockInUse(display))
+            continue;
+        if (sockets.count(display) && SocketInUse(display))
+            continue;
+        if (leases && (fd = ClaimLease(display)) < 0)
+            continue;
+        number = display;
+        return display;
+    }
+}
+
+void CDisplayLease::Reserve(unsigned display)
+{
+    Release();
+    if (LeaseDirectory() && (fd = ClaimLease(display)) >= 0)
+        number = display;
+}
+
+void CDisplayLease::Release()
+{
+    if (fd < 0)
+        return;
+    ReleaseLease(number, fd);
+    fd = -1;
+}
@@ -0,0 +1,63 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __LEASE_H__
+#define __LEASE_H__
+
+/* Directory of the leases of the displays reserved by xlaunch processes */
+#ifndef LEASE_DIR
+#define LEASE_DIR "/tmp/.xlaunch-leases"
+#endif
+
+/// @brief Reservation of a display number.
+/// Each display reserved is a file in a directory shared by all users,
+/// which its xlaunch process keeps locked, so concurrent launches never
+/// pick the same number. Reservations of processes which are gone are
+/// taken over.
+class CDisplayLease
+{
+    private:
+        int fd;
+        unsigned number;
+        CDisplayLease(const CDisplayLease &);
+        CDisplayLease &operator=(const CDisplayLease &);
+    public:
+        CDisplayLease() : fd(-1), number(0) {}
+        ~CDisplayLease() { Release(); }
+        /// @brief Reserve the lowest free display number.
+        /// A number is free when no xlaunch has reserved it and no live X
+        /// server holds its lock file or listens on its socket. Lock files
+        /// and sockets left behind by dead servers are removed. If the
+        /// lease directory can't be used, only the running servers are
+        /// avoided.
+        /// @param first Lowest number to consider.
+        unsigned Acquire(unsigned first = 0);
+        /// @brief Reserve a display number chosen by the user, so automatic
+        /// allocation doesn't pick it. Failures are ignored.
+        void Reserve(unsigned display);
+        /// @brief Give the display number back.
+        void Release();
+        unsigned Number() const { return number; }
+};
+
+#endif
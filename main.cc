@@ -28,31 +28,47 @@
 #include "window/wizard.h"
 #include "resources/resources.h"
 #include "config.h"
+#include "configcache.h"
 #include "file.h"
+#include "trace.h"
+#include "stats.h"
+#include "session.h"
+#include "daemon.h"
+#include "validate.h"
 
 #include <prsht.h>
 #include <commctrl.h>
 #include <htmlhelp.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/cygwin.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <stdexcept>
+#include <algorithm>
 
 #include <X11/Xlib.h>
 
-#ifdef _DEBUG
-static bool debug = true;
-#else
-static bool debug = false;
-#endif
-
-/// @brief Send WM_ENDSESSION to all program windows.
-/// This will shutdown the started xserver
-BOOL CALLBACK KillWindowsProc(HWND hwnd, LPARAM lParam)
+/// @brief Load a configuration file, reporting errors.
+/// @return Full path of the file, which identifies the configuration.
+static std::string LoadConfigFile(const char *filename, CConfig &config)
 {
-    SendMessage(hwnd, WM_ENDSESSION, 0, 0);
-    return TRUE;
+    CTraceScope trace("CConfig::Load");
+    char *path = realpath(filename, NULL);
+    std::string ret = path ? path : filename;
+    free(path);
+    if (!LoadCompiledConfig(ret.c_str(), config))
+        printf("Error: Can't load %s\n", filename);
+    return ret;
 }
 
+/* Attributes set on each page, for checking them when leaving it */
+static const char *const display_fields[] = { "Display", NULL };
+static const char *const program_fields[] = { "LocalProgram", "RemoteProgram", "RemoteHost", "RemoteProtocol", NULL };
+static const char *const moreclients_fields[] = { "Client", NULL };
+static const char *const xdmcp_fields[] = { "ClientMode", "XDMCPHost", NULL };
+static const char *const extra_fields[] = { "ExtraParams", NULL };
+
 /// @brief Actual wizard implementation.
 /// This is based on generic CWizard but handles the special dialogs
 class CMyWizard : public CWizard
@@ -60,6 +76,8 @@ class CMyWizard : public CWizard
     public:
     private:
 	CConfig config; /// Storage for config options.
+	std::string configfile; /// Name of the loaded config file, if any.
+	std::string metricsfile; /// File to write resource usage to, if any.
     public:
         /// @brief Constructor.
         /// Set wizard pages.
@@ -68,6 +86,7 @@ class CMyWizard : public CWizard
           AddPage(IDD_DISPLAY, IDS_DISPLAY_CAPTION, IDS_DISPLAY_TITLE, IDS_DISPLAY_SUBTITLE);
           AddPage(IDD_CLIENTS, IDS_CLIENTS_CAPTION, IDS_CLIENTS_TITLE, IDS_CLIENTS_SUBTITLE);
           AddPage(IDD_PROGRAM, IDS_PROGRAM_CAPTION, IDS_PROGRAM_TITLE, IDS_PROGRAM_SUBTITLE);
+          AddPage(IDD_MORECLIENTS, IDS_MORECLIENTS_CAPTION, IDS_MORECLIENTS_TITLE, IDS_MORECLIENTS_SUBTITLE);
           AddPage(IDD_XDMCP, IDS_XDMCP_CAPTION, IDS_XDMCP_TITLE, IDS_XDMCP_SUBTITLE);
           AddPage(IDD_EXTRA, IDS_EXTRA_CAPTION, IDS_EXTRA_TITLE, IDS_EXTRA_SUBTITLE);
           AddPage(IDD_FINISH, IDS_FINISH_CAPTION, IDS_FINISH_TITLE, IDS_FINISH_SUBTITLE);
@@ -75,12 +94,37 @@ class CMyWizard : public CWizard
 
 	virtual void LoadConfig(const char *filename)
 	{
-	    try {
-		config.Load(filename);
-	    } catch (std::runtime_error &e)
-	    {
-		printf("Error: %s\n", e.what());
-	    }
+	    configfile = LoadConfigFile(filename, config);
+	}
+
+	void SetMetricsFile(const char *filename)
+	{
+	    metricsfile = filename;
+	}
+
+	/// @brief Show the first problem with the settings of a page.
+	/// @param fields Attributes the page sets, NULL terminated.
+	/// @return false if there was a problem.
+	bool CheckPage(HWND hwndDlg, const char *const *fields)
+	{
+	    std::vector<CConfigProblem> problems;
+	    config.Validate(problems);
+	    for (size_t i = 0; i < problems.size(); i++)
+		for (int f = 0; fields[f]; f++)
+		    if (problems[i].field == fields[f])
+		    {
+			std::string message = problems[i].message;
+			message[0] = toupper(message[0]);
+			MessageBox(hwndDlg, message.c_str(), "Error", MB_OK);
+			return false;
+		    }
+	    return true;
+	}
+
+	/// @brief Create a session running the current configuration.
+	CSession *CreateSession()
+	{
+	    return new CSession(config, configfile.empty() ? "(wizard)" : configfile, metricsfile);
 	}
 
         /// @brief Handle the PSN_WIZNEXT message.
@@ -117,11 +161,8 @@ class CMyWizard : public CWizard
 			config.display = buffer;
                     }
                     // Check for valid input
-                    if (config.display.empty())
-                      {
-			MessageBox(hwndDlg,"Please fill in a display number.","Error",MB_OK);
+                    if (!CheckPage(hwndDlg, display_fields))
 			SetWindowLong(hwndDlg, DWLP_MSGRESULT, -1);
-                      }
                     else
                         SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_CLIENTS);
 		    return TRUE;
@@ -193,11 +234,45 @@ class CMyWizard : public CWizard
 			config.extra_ssh = buffer;
 		    }
                     // Check for valid input
-		    if ((!config.local && (config.host.empty() || config.remoteprogram.empty())) || config.localprogram.empty())
-                      {
-			MessageBox(hwndDlg,"Please fill in details of the program to start", "Error", MB_OK);
+		    if (!CheckPage(hwndDlg, program_fields))
+			SetWindowLong(hwndDlg, DWLP_MSGRESULT, -1);
+		    else
+			SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_MORECLIENTS);
+		    return TRUE;
+		case IDD_MORECLIENTS:
+                    // Read one program per line, "remote:" ones run on the remote host
+		    {
+			HWND edit = GetDlgItem(hwndDlg, IDC_MORECLIENTS);
+			std::vector<char> buffer(GetWindowTextLength(edit) + 1);
+			GetWindowText(edit, &buffer[0], buffer.size());
+			std::string text(&buffer[0]);
+			config.clients.clear();
+			size_t start = 0;
+			while (start < text.size())
+			{
+			    size_t end = text.find('\n', start);
+			    if (end == std::string::npos)
+				end = text.size();
+			    std::string line = text.substr(start, end - start);
+			    start = end + 1;
+			    if (!line.empty() && line[line.size() - 1] == '\r')
+				line.erase(line.size() - 1);
+			    CClientEntry entry;
+			    if (line.compare(0, 7, "remote:") == 0)
+			    {
+				entry.local = false;
+				line.erase(0, 7);
+			    }
+			    size_t first = line.find_first_not_of(" \t");
+			    if (first == std::string::npos)
+				continue;
+			    entry.program = line.substr(first);
+			    config.clients.push_back(entry);
+			}
+		    }
+		    config.autostart = IsDlgButtonChecked(hwndDlg, IDC_AUTOSTART) != 0;
+		    if (!CheckPage(hwndDlg, moreclients_fields))
 			SetWindowLong(hwndDlg, DWLP_MSGRESULT, -1);
-                      }
 		    else
 			SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_EXTRA);
 		    return TRUE;
@@ -225,7 +300,7 @@ class CMyWizard : public CWizard
 			config.xdmcp_host = buffer;
 		    }
                     // Check for valid input
-		    if (!config.broadcast && config.xdmcp_host.empty())
+		    if (!CheckPage(hwndDlg, xdmcp_fields))
 			SetWindowLong(hwndDlg, DWLP_MSGRESULT, -1);
 		    else
 			SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_EXTRA);
@@ -257,7 +332,10 @@ class CMyWizard : public CWizard
 			buffer[511] = 0;
 			config.extra_params = buffer;
 		    }
-                    SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_FINISH);
+                    if (!CheckPage(hwndDlg, extra_fields))
+                        SetWindowLong(hwndDlg, DWLP_MSGRESULT, -1);
+                    else
+                        SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_FINISH);
                     return TRUE;
 		default:
 		    break;
@@ -289,6 +367,9 @@ class CMyWizard : public CWizard
 		case IDD_XDMCP:
 		    SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_CLIENTS);
 		    return TRUE;
+		case IDD_MORECLIENTS:
+		    SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_PROGRAM);
+		    return TRUE;
 		case IDD_EXTRA:
 		    switch (config.client)
 		    {
@@ -296,7 +377,7 @@ class CMyWizard : public CWizard
 			    SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_CLIENTS);
 			    return TRUE;
 			case CConfig::StartProgram:
-			    SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_PROGRAM);
+			    SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_MORECLIENTS);
 			    return TRUE;
 			case CConfig::XDMCP:
 			    SetWindowLong(hwndDlg, DWLP_MSGRESULT, IDD_XDMCP);
@@ -338,6 +419,7 @@ class CMyWizard : public CWizard
 	    if (idd==IDD_DISPLAY) offset = 0;
 	    else if (idd==IDD_CLIENTS) offset = 1;
 	    else if (idd==IDD_PROGRAM) offset = 2;
+	    else if (idd==IDD_MORECLIENTS) offset = 2;
 	    else if (idd==IDD_XDMCP) offset = 3;
 	    else if (idd==IDD_EXTRA) offset = 4;
 	    else if (idd==IDD_FINISH) offset = 5;
@@ -534,6 +616,21 @@ class CMyWizard : public CWizard
 			    CheckDlgButton(hwndDlg, IDC_CLIENT_SSH_TERMINAL, config.terminal?BST_CHECKED:BST_UNCHECKED);
                             SetDlgItemText(hwndDlg, IDC_CLIENT_PROTOCOL_EXTRA_PARAMS, config.extra_ssh.c_str());
 			    break;
+			case IDD_MORECLIENTS:
+			    psp->dwFlags |= PSP_HASHELP;
+                            // One program per line
+			    {
+				std::string text;
+				for (size_t i = 0; i < config.clients.size(); i++)
+				{
+				    if (!config.clients[i].local)
+					text += "remote:";
+				    text += config.clients[i].program + "\r\n";
+				}
+				SetDlgItemText(hwndDlg, IDC_MORECLIENTS, text.c_str());
+			    }
+			    CheckDlgButton(hwndDlg, IDC_AUTOSTART, config.autostart?BST_CHECKED:BST_UNCHECKED);
+			    break;
 			case IDD_XDMCP:
 			    psp->dwFlags |= PSP_HASHELP;
                             // Init XDMCP dialog. Check broadcast and indirect button
@@ -586,242 +683,62 @@ class CMyWizard : public CWizard
             return CWizard::PageDispatch(hwndDlg, uMsg, wParam, lParam, psp);
         }
 
-        /// @brief Try to connect to server.
-        /// Repeat until successful, server died or maximum number of retries
-        /// reached.
-        Display *WaitForServer(HANDLE serverProcess, std::string &display)
-        {
-            int     ncycles  = 120;         /* # of cycles to wait */
-            int     cycles;                 /* Wait cycle count */
-            Display *xd;
-
-            for (cycles = 0; cycles < ncycles; cycles++) {
-              if ((xd = XOpenDisplay(display.c_str()))) {
-                    return xd;
-                }
-                else {
-                    if (WaitForSingleObject(serverProcess, 1000) == WAIT_TIMEOUT)
-                        continue;
-                    else
-                      break;
-                }
-            }
-            return NULL;
-        }
-
-        /// @brief Do the actual start of X server and clients
-	void StartUp()
-	{
-	    std::string buffer;
-	    std::string client;
-	    BOOL showconsole = FALSE;
-
-            // Construct display strings
-	    std::string display_id = ":" + config.display;
-	    std::string display = display_id + ".0";
-
-            // Build X server commandline
-#if defined (__CYGWIN__)
-	    buffer = "XWin " + display_id + " ";
-#elif defined (__MINGW__)
-	    buffer = "Xming " + display_id + " ";
-#else
-#error "Don't know X server name"
-#endif
-	    switch (config.window)
-	    {
-		case CConfig::MultiWindow:
-		    buffer += "-multiwindow ";
-		    break;
-		case CConfig::Fullscreen:
-		    buffer += "-fullscreen ";
-		    break;
-		case CConfig::Nodecoration:
-		    buffer += "-nodecoration ";
-		    break;
-		default:
-		    break;
-	    }
-            // Add XDMCP parameter
-	    if (config.client == CConfig::XDMCP)
-	    {
-		if (config.broadcast)
-		    buffer += "-broadcast ";
-		else
-		{
-		    if (config.indirect)
-			buffer += "-indirect ";
-		    else
-			buffer += "-query ";
-		    buffer += config.xdmcp_host;
-            buffer += " ";
-		}
-                if (config.xdmcpterminate)
-                    buffer += "-terminate ";
-	    }
-            if (config.clipboard)
-                buffer += "-clipboard ";
-            else
-                buffer += "-noclipboard ";
-            if (config.wgl)
-                buffer += "-wgl ";
-            else
-                buffer += "-nowgl ";
-            if (config.disableac)
-                buffer += "-ac ";
-            if (!config.extra_params.empty())
-            {
-                buffer += config.extra_params;
-                buffer += " ";
-            }
-
-            // Construct client commandline
-	    if (config.client == CConfig::StartProgram)
-	    {
-		if (!config.local)
-		{
-		    char cmdline[512];
-                    std::string host = config.host;
-                    std::string rsh_l_option = "";
-                    if (!config.user.empty())
-                      {
-                        host = config.user + "@" + config.host;
-                        rsh_l_option = "-l " + config.user;
-                      }
-
-                    if (config.protocol == "ssh")
-                      {
-                        snprintf(cmdline,512,"ssh -Y %s %s %s",
-                                 host.c_str(), config.extra_ssh.c_str(), config.remoteprogram.c_str());
-                        client = cmdline;
-
-                        if (config.keychain)
-                          {
-                            client = ". ~/.keychain/$HOSTNAME-sh ; " + client;
-                            client = "bash -c \"" + client + "\"";
-                          }
-
-                        if (config.terminal)
-                          {
-                            showconsole = TRUE;
-                            client = "mintty -e " + client;
-                          }
-                      }
-                    else if (config.protocol == "rsh")
-                      {
-                        snprintf(cmdline,512,"rsh %s %s %s",
-                                 rsh_l_option.c_str(),
-                                 config.host.c_str(),config.remoteprogram.c_str());
-                        client = cmdline;
-                      }
-		} else {
-#if defined (__CYGWIN__)
-                  client = "bash -l -c \"" + config.localprogram + "\"";
-#elif defined (__MINGW__)
-                  client = config.localprogram.c_str();
-#else
-#error "Don't know how to start child process on target"
-#endif
-                }
-	    }
-
-            // Prepare program startup
-     	    STARTUPINFO si, sic;
-	    PROCESS_INFORMATION pi, pic;
-	    HANDLE handles[2];
-	    DWORD hcount = 0;
-            Display *dpy = NULL;
-
-	    ZeroMemory( &si, sizeof(si) );
-	    si.cb = sizeof(si);
-	    ZeroMemory( &pi, sizeof(pi) );
-	    ZeroMemory( &sic, sizeof(sic) );
-	    sic.cb = sizeof(sic);
-	    ZeroMemory( &pic, sizeof(pic) );
-
-	    // Start X server process
-            if (debug)
-              printf("Server: %s\n", buffer.c_str());
-
-	    if( !CreateProcess( NULL, (CHAR*)buffer.c_str(), NULL, NULL,
-                        FALSE, 0, NULL, NULL, &si, &pi ))
-		throw win32_error("CreateProcess failed");
-	    handles[hcount++] = pi.hProcess;
-
-	    if (!client.empty())
-	    {
-                // Set DISPLAY variable
-		SetEnvironmentVariable("DISPLAY",display.c_str());
-
-                // Wait for server to startup
-                dpy = WaitForServer(pi.hProcess, display);
-                if (dpy == NULL)
-                {
-                    while (hcount--)
-                        TerminateProcess(handles[hcount], (DWORD)-1);
-		    throw std::runtime_error("Connection to server failed");
-                }
-
-                if (debug)
-                  printf("Client: %s\n", client.c_str());
-
-                // Hide console window, unless showconsole is true
-		sic.dwFlags = STARTF_USESHOWWINDOW;
-		sic.wShowWindow = SW_HIDE;
-		if (showconsole) sic.wShowWindow = SW_NORMAL;
-
-		// Start the child process.
-		if( !CreateProcess( NULL, (CHAR*)client.c_str(), NULL, NULL,
-                            FALSE, 0, NULL, NULL, &sic, &pic ))
-		{
-                    DWORD err = GetLastError();
-                    while (hcount--)
-                        TerminateProcess(handles[hcount], (DWORD)-1);
-		    throw win32_error("CreateProcess failed", err);
-		}
-		handles[hcount++] = pic.hProcess;
-	    }
+};
 
-	    // Wait until any child process exits.
-	    WaitForMultipleObjects(hcount, handles, FALSE, INFINITE);
+/// @brief Add a configuration file to run, or all in a directory.
+static void AddRunFiles(const char *path, std::vector<std::string> &files)
+{
+    struct stat st;
+    DIR *dir;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode) || (dir = opendir(path)) == NULL)
+    {
+        files.push_back(path);
+        return;
+    }
 
-            // Check if X server is still running, but only when we started a local program
-            if (config.local)
-            {
-#ifdef _DEBUG
-	    printf("killing process\n");
-#endif
+    std::vector<std::string> found;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        std::string name(entry->d_name);
+        if (name.size() > 8 && name.compare(name.size() - 8, 8, ".xlaunch") == 0)
+            found.push_back(std::string(path) + "/" + name);
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
 
-	    DWORD exitcode;
-	    GetExitCodeProcess(pi.hProcess, &exitcode);
-	    unsigned counter = 0;
-	    while (exitcode == STILL_ACTIVE)
-	    {
-		if (++counter > 10)
-                  {
-                    if (debug)
-                      printf("X server didn't stop after WM_ENDSESSION, force terminating process\n");
-
-		    TerminateProcess(pi.hProcess, (DWORD)-1);
-                  }
-		else
-		    // Shutdown X server (the soft way!)
-		    EnumThreadWindows(pi.dwThreadId, KillWindowsProc, 0);
-
-		Sleep(500);
-		GetExitCodeProcess(pi.hProcess, &exitcode);
-	    }
-	    // Kill the client
-	    TerminateProcess(pic.hProcess, (DWORD)-1);
-            }
+/// @brief Send a command to the daemon and print its reply.
+/// Configuration files are passed by absolute path, or inline if given as -.
+/// @return 0 if the daemon replied ok.
+static int SendCommand(int argc, char **argv)
+{
+    std::string request = argv[0];
+    if (request == "launch" && argc > 1 && std::string(argv[1]) == "-")
+    {
+        request += "\n";
+        char buffer[4096];
+        size_t len;
+        while ((len = fread(buffer, 1, sizeof(buffer), stdin)) > 0)
+            request.append(buffer, len);
+    }
+    else if (request == "launch" && argc > 1)
+    {
+        char *path = realpath(argv[1], NULL);
+        if (path == NULL)
+            throw std::runtime_error(std::string("Can't find ") + argv[1]);
+        request += std::string(" ") + path;
+        free(path);
+    }
+    else
+        for (int i = 1; i < argc; i++)
+            request += std::string(" ") + argv[i];
 
-	    // Close process and thread handles.
-	    CloseHandle( pi.hProcess );
-	    CloseHandle( pi.hThread );
-	    CloseHandle( pic.hProcess );
-	    CloseHandle( pic.hThread );
-	}
-};
+    std::string reply = SendToDaemon(request);
+    printf("%s", reply.c_str());
+    return reply.compare(0, 2, "ok") == 0 ? 0 : 1;
+}
 
 void usage(void)
 {
@@ -830,7 +747,25 @@ void usage(void)
   printf("\n");
   printf("  -debug         enable debug output\n");
   printf("  -load filename load configuration from file\n");
-  printf("  -run filename  load and run configuration from file\n");
+  printf("  -run filename...\n");
+  printf("                 load and run configurations from files, or all .xlaunch\n");
+  printf("                 files in a directory, each on its own display\n");
+  printf("  -watch         apply changes to the files given to -run while they run,\n");
+  printf("                 restarting only the client where that is enough\n");
+  printf("  -validate filename...\n");
+  printf("                 check configurations from files, or all .xlaunch files in a\n");
+  printf("                 directory, print a line per file and problem and exit\n");
+  printf("                 non-zero if there were problems\n");
+  printf("  -metrics filename\n");
+  printf("                 periodically write resource usage of server and client to file\n");
+  printf("  -daemon        run configurations on request of other processes\n");
+  printf("  -send command [argument]\n");
+  printf("                 send a command to the daemon: launch file, launch - (read\n");
+  printf("                 the configuration from stdin), stop id, client id [program],\n");
+  printf("                 status or quit\n");
+  printf("  -stats         print launch time statistics and exit\n");
+  printf("  -trace filename\n");
+  printf("                 write a timeline of the launch to file, in Chrome trace format\n");
   printf("  -help          display this help and exit\n");
   printf("  -version       output version information and exit\n");
   printf("\n");
@@ -845,11 +780,24 @@ int main(int argc, char **argv)
     // if we don't have Adminstrator privileges.
     cygwin_internal(CW_SYNC_WINENV);
 
+    // Deleting a session stops and joins its thread, which must happen
+    // on every way out
+    std::vector<CSession *> sessions;
     try {
         InitCommonControls();
         CMyWizard dialog;
 
-	bool skip_wizard = false;
+	std::vector<std::string> runfiles;
+	std::vector<std::string> validatefiles;
+	std::string metricsfile;
+	bool daemon = false;
+	bool validate = false;
+	bool watch = false;
+
+	// Start tracing first, so loading the configuration is included
+	for (int i = 1; i + 1 < argc; i++)
+	    if (argv[i] && std::string(argv[i]) == "-trace")
+		CTrace::Open(argv[i + 1]);
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -867,6 +815,11 @@ int main(int argc, char **argv)
                 printf(PACKAGE_STRING);
                 return 0;
               }
+            else if (arg == "-stats")
+              {
+                CLaunchStats::Print();
+                return 0;
+              }
             else if (arg == "-debug")
               {
                 debug = true;
@@ -877,23 +830,96 @@ int main(int argc, char **argv)
 		dialog.LoadConfig(argv[i]);
               }
             else if (arg == "-run" && i + 1 < argc)
+              {
+		// Take all following arguments up to the next option
+		do
+		    AddRunFiles(argv[++i], runfiles);
+		while (i + 1 < argc && argv[i + 1] && argv[i + 1][0] != '-');
+              }
+            else if (arg == "-watch")
+              {
+		watch = true;
+              }
+            else if (arg == "-validate" && i + 1 < argc)
+              {
+		validate = true;
+		do
+		    AddRunFiles(argv[++i], validatefiles);
+		while (i + 1 < argc && argv[i + 1] && argv[i + 1][0] != '-');
+              }
+            else if (arg == "-metrics" && i + 1 < argc)
               {
 		i++;
-		dialog.LoadConfig(argv[i]);
-		skip_wizard = true;
+		metricsfile = argv[i];
+		dialog.SetMetricsFile(argv[i]);
+              }
+            else if (arg == "-trace" && i + 1 < argc)
+              {
+		i++;
+              }
+            else if (arg == "-daemon")
+              {
+		daemon = true;
+              }
+            else if (arg == "-send" && i + 1 < argc)
+              {
+		return SendCommand(argc - i - 1, argv + i + 1);
               }
 	}
 
+	if (validate)
+	    return ValidateConfigs(validatefiles, stdout);
+
+	// Sessions use Xlib from their own threads
+	XInitThreads();
+
+	if (daemon)
+	{
+	    CDaemon broker(metricsfile);
+	    broker.Run();
+	    CTrace::Close();
+	    return 0;
+	}
+
 	int ret = 0;
-        if (skip_wizard || (ret =dialog.ShowModal()) != 0)
-	    dialog.StartUp();
+	for (size_t i = 0; i < runfiles.size(); i++)
+	{
+	    CConfig config;
+	    std::string name = LoadConfigFile(runfiles[i].c_str(), config);
+	    sessions.push_back(new CSession(config, name, metricsfile, runfiles.size() > 1));
+	    if (watch)
+		sessions.back()->Watch(name);
+	}
+        if (runfiles.empty() && (ret =dialog.ShowModal()) != 0)
+	    sessions.push_back(dialog.CreateSession());
+
+	bool failed = false;
+	if (sessions.size() == 1)
+	    sessions[0]->Run();
+	else
+	{
+	    // Each session waits for its own processes, so there is no limit
+	    // on the number of handles a single wait could watch
+	    for (size_t i = 0; i < sessions.size(); i++)
+		sessions[i]->Start();
+	    for (size_t i = 0; i < sessions.size(); i++)
+		if (!sessions[i]->Join())
+		    failed = true;
+	}
+	for (size_t i = 0; i < sessions.size(); i++)
+	    delete sessions[i];
+	sessions.clear();
 #ifdef _DEBUG
 	printf("return %d\n", ret);
 #endif
-	return 0;
+	CTrace::Close();
+	return failed ? -1 : 0;
     } catch (std::runtime_error &e)
     {
         printf("Error: %s\n", e.what());
+        for (size_t i = 0; i < sessions.size(); i++)
+            delete sessions[i];
+        CTrace::Close();
         return -1;
     }
 }
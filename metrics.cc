@@ -0,0 +1,221 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include <stdio.h>
+#include <tlhelp32.h>
+#include <psapi.h>
+#include <map>
+#include "metrics.h"
+
+static unsigned long long FileTimeValue(const FILETIME &ft)
+{
+    return ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+CResourceMetrics::CResourceMetrics(const std::string &filename, const std::string &display) :
+    filename(filename), display(display), last_sample(0), sampled(false)
+{
+}
+
+void CResourceMetrics::AddProcess(const char *role, HANDLE process)
+{
+    Tree tree;
+    tree.role = role;
+    tree.process = process;
+    tree.gone_cpu = 0;
+    tree.exited = false;
+    tree.exitcode = 0;
+    ZeroMemory(&tree.usage, sizeof(tree.usage));
+    trees.push_back(tree);
+}
+
+void CResourceMetrics::RemoveProcess(HANDLE process)
+{
+    for (std::vector<Tree>::iterator i = trees.begin(); i != trees.end(); ++i)
+        if (i->process == process)
+        {
+            trees.erase(i);
+            return;
+        }
+}
+
+/// @brief Add up the usage of a process and all its descendants.
+void CResourceMetrics::SampleTree(Tree &tree, HANDLE snapshot)
+{
+    Usage usage;
+    ZeroMemory(&usage, sizeof(usage));
+
+    // Map parent process ids to their children
+    std::multimap<DWORD, PROCESSENTRY32> children;
+    std::map<DWORD, DWORD> threads;
+    PROCESSENTRY32 entry;
+    entry.dwSize = sizeof(entry);
+    if (snapshot != INVALID_HANDLE_VALUE && Process32First(snapshot, &entry))
+    {
+        do {
+            children.insert(std::make_pair(entry.th32ParentProcessID, entry));
+            threads[entry.th32ProcessID] = entry.cntThreads;
+        } while (Process32Next(snapshot, &entry));
+    }
+
+    CpuTimes cpu;
+    std::vector<std::pair<HANDLE, DWORD> > pending;
+    pending.push_back(std::make_pair(tree.process, GetProcessId(tree.process)));
+    while (!pending.empty())
+    {
+        HANDLE process = pending.back().first;
+        DWORD pid = pending.back().second;
+        pending.pop_back();
+
+        FILETIME creation, exit, kernel, user;
+        if (GetProcessTimes(process, &creation, &exit, &kernel, &user))
+        {
+            cpu[std::make_pair(pid, FileTimeValue(creation))] =
+                (FileTimeValue(kernel) + FileTimeValue(user)) / 1e7;
+
+            // Children created before their parent are from a reused pid
+            std::pair<std::multimap<DWORD, PROCESSENTRY32>::iterator,
+                      std::multimap<DWORD, PROCESSENTRY32>::iterator> range = children.equal_range(pid);
+            for (std::multimap<DWORD, PROCESSENTRY32>::iterator i = range.first; i != range.second; ++i)
+            {
+                if (i->second.th32ProcessID == pid)
+                    continue;
+                HANDLE child = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ,
+                                           FALSE, i->second.th32ProcessID);
+                if (child == NULL)
+                    continue;
+                FILETIME child_creation, child_exit, child_kernel, child_user;
+                if (GetProcessTimes(child, &child_creation, &child_exit, &child_kernel, &child_user) &&
+                    FileTimeValue(child_creation) >= FileTimeValue(creation))
+                    pending.push_back(std::make_pair(child, i->second.th32ProcessID));
+                else
+                    CloseHandle(child);
+            }
+        }
+
+        PROCESS_MEMORY_COUNTERS memory;
+        if (GetProcessMemoryInfo(process, &memory, sizeof(memory)))
+        {
+            usage.resident += memory.WorkingSetSize;
+            usage.peak_resident += memory.PeakWorkingSetSize;
+        }
+        DWORD handles;
+        if (GetProcessHandleCount(process, &handles))
+            usage.handles += handles;
+        usage.threads += threads[pid];
+        usage.processes++;
+
+        if (process != tree.process)
+            CloseHandle(process);
+    }
+
+    // Keep the time of the processes which exited, so the total never drops
+    for (CpuTimes::iterator i = tree.cpu.begin(); i != tree.cpu.end(); ++i)
+        if (cpu.find(i->first) == cpu.end())
+            tree.gone_cpu += i->second;
+    tree.cpu.swap(cpu);
+    usage.cpu = tree.gone_cpu;
+    for (CpuTimes::iterator i = tree.cpu.begin(); i != tree.cpu.end(); ++i)
+        usage.cpu += i->second;
+
+    DWORD exitcode;
+    if (GetExitCodeProcess(tree.process, &exitcode) && exitcode != STILL_ACTIVE)
+    {
+        tree.exited = true;
+        tree.exitcode = exitcode;
+    }
+    // Processes which are gone no longer report their peak
+    if (usage.peak_resident < tree.usage.peak_resident)
+        usage.peak_resident = tree.usage.peak_resident;
+    tree.usage = usage;
+}
+
+void CResourceMetrics::Sample(bool final)
+{
+    DWORD now = GetTickCount();
+    if (!final && sampled && now - last_sample < METRICS_INTERVAL)
+        return;
+    sampled = true;
+    last_sample = now;
+
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    for (size_t i = 0; i < trees.size(); i++)
+        SampleTree(trees[i], snapshot);
+    if (snapshot != INVALID_HANDLE_VALUE)
+        CloseHandle(snapshot);
+
+    Write();
+}
+
+void CResourceMetrics::Write()
+{
+    static const struct {
+        const char *name;
+        const char *type;
+        const char *help;
+    } metrics[] = {
+        { "xlaunch_processes", "gauge", "Number of processes in the tree." },
+        { "xlaunch_cpu_seconds_total", "counter", "CPU time used by the processes in the tree, including those which have exited." },
+        { "xlaunch_resident_bytes", "gauge", "Working set size of the processes in the tree." },
+        { "xlaunch_peak_resident_bytes", "gauge", "Peak working set size of the processes in the tree." },
+        { "xlaunch_threads", "gauge", "Number of threads in the tree." },
+        { "xlaunch_handles", "gauge", "Number of handles open in the tree." },
+        { "xlaunch_exit_code", "gauge", "Exit code of the process, once it has exited." },
+    };
+
+    std::string temp = filename + ".tmp";
+    FILE *f = fopen(temp.c_str(), "w");
+    if (f == NULL)
+        return;
+
+    for (unsigned m = 0; m < sizeof(metrics) / sizeof(metrics[0]); m++)
+    {
+        fprintf(f, "# HELP %s %s\n", metrics[m].name, metrics[m].help);
+        fprintf(f, "# TYPE %s %s\n", metrics[m].name, metrics[m].type);
+        for (size_t i = 0; i < trees.size(); i++)
+        {
+            const Usage &usage = trees[i].usage;
+            char value[32];
+            switch (m)
+            {
+                case 0: snprintf(value, sizeof(value), "%u", usage.processes); break;
+                case 1: snprintf(value, sizeof(value), "%.3f", usage.cpu); break;
+                case 2: snprintf(value, sizeof(value), "%llu", usage.resident); break;
+                case 3: snprintf(value, sizeof(value), "%llu", usage.peak_resident); break;
+                case 4: snprintf(value, sizeof(value), "%lu", usage.threads); break;
+                case 5: snprintf(value, sizeof(value), "%lu", usage.handles); break;
+                case 6:
+                    if (!trees[i].exited)
+                        continue;
+                    snprintf(value, sizeof(value), "%lu", (unsigned long)trees[i].exitcode);
+                    break;
+            }
+            fprintf(f, "%s{display=\"%s\",role=\"%s\"} %s\n", metrics[m].name,
+                    display.c_str(), trees[i].role.c_str(), value);
+        }
+    }
+
+    if (fclose(f) == 0)
+        rename(temp.c_str(), filename.c_str());
+}
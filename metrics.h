@@ -0,0 +1,87 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <map>
+
+/* Minimum time between two samples, in ms */
+#define METRICS_INTERVAL 5000
+
+/// @brief Resource usage of the process trees of a session.
+/// Samples CPU time, memory, thread and handle counts of each registered
+/// process and its descendants and writes them to a file in the Prometheus
+/// text exposition format.
+class CResourceMetrics
+{
+    private:
+        struct Usage
+        {
+            unsigned processes;
+            double cpu;
+            unsigned long long resident;
+            unsigned long long peak_resident;
+            unsigned long threads;
+            unsigned long handles;
+        };
+        /// CPU time of processes, by pid and creation time
+        typedef std::map<std::pair<DWORD, unsigned long long>, double> CpuTimes;
+        struct Tree
+        {
+            std::string role;
+            HANDLE process;
+            Usage usage;
+            /// CPU time last seen of each process in the tree
+            CpuTimes cpu;
+            /// CPU time of the processes which have gone since
+            double gone_cpu;
+            bool exited;
+            DWORD exitcode;
+        };
+        std::string filename;
+        std::string display;
+        std::vector<Tree> trees;
+        DWORD last_sample;
+        bool sampled;
+        void SampleTree(Tree &tree, HANDLE snapshot);
+        void Write();
+    public:
+        /// @param filename File to write the metrics to.
+        /// @param display Display name used to label the metrics.
+        CResourceMetrics(const std::string &filename, const std::string &display);
+        /// @brief Include a process and its descendants in the samples.
+        /// @param role Label for the process tree, eg. "server" or "client".
+        void AddProcess(const char *role, HANDLE process);
+        /// @brief Stop sampling a process, eg. one which was replaced.
+        void RemoveProcess(HANDLE process);
+        /// @brief Sample and write the metrics, unless sampled recently.
+        /// @param final Sample regardless of the interval, and include the
+        /// exit status of processes which have exited.
+        void Sample(bool final = false);
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include "monitor.h"
+#include "window/util.h"
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+/// @brief Note the loss of the connection to the server.
+/// Xlib exits the process after an I/O error unless the display has an
+/// exit handler. With this one it returns to the call which failed, and
+/// later calls on the display do nothing, so the monitor thread ends normally.
+void CServerMonitor::IOErrorExit(Display *dpy, void *data)
+{
+    CServerMonitor *monitor = (CServerMonitor *)data;
+    EnterCriticalSection(&monitor->lock);
+    monitor->lost = true;
+    monitor->pending = false;
+    LeaveCriticalSection(&monitor->lock);
+}
+#endif
+
+/// @brief Check if the server closed the connection, before Xlib runs into it.
+static bool Disconnected(Display *dpy)
+{
+    struct pollfd fd = { ConnectionNumber(dpy), POLLIN, 0 };
+    if (poll(&fd, 1, 0) <= 0)
+        return false;
+    if (fd.revents & (POLLERR | POLLHUP | POLLNVAL))
+        return true;
+    char c;
+    return recv(fd.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+CServerMonitor::CServerMonitor(Display *dpy, DWORD interval, DWORD threshold) :
+    dpy(dpy), interval(interval), threshold(threshold), thread(NULL), stop(NULL),
+    pending(false), lost(false), sent(0), last_rtt(0), max_rtt(0), total_rtt(0),
+    count(0)
+{
+    InitializeCriticalSection(&lock);
+#ifdef HAVE_XSETIOERROREXITHANDLER
+    XSetIOErrorExitHandler(dpy, IOErrorExit, this);
+#endif
+
+    stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (stop == NULL)
+        throw win32_error("CreateEvent failed");
+    thread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+    if (thread == NULL)
+    {
+        DWORD err = GetLastError();
+        CloseHandle(stop);
+        throw win32_error("CreateThread failed", err);
+    }
+}
+
+CServerMonitor::~CServerMonitor()
+{
+    CloseHandle(thread);
+    CloseHandle(stop);
+    DeleteCriticalSection(&lock);
+}
+
+DWORD WINAPI CServerMonitor::ThreadProc(LPVOID param)
+{
+    CServerMonitor *monitor = (CServerMonitor *)param;
+    monitor->Run();
+    return 0;
+}
+
+void CServerMonitor::Run()
+{
+    bool closed = false;
+    while (WaitForSingleObject(stop, interval) == WAIT_TIMEOUT)
+    {
+        // A server which went away is noticed here, rather than by Xlib
+        if (Disconnected(dpy))
+        {
+            closed = true;
+            break;
+        }
+
+        EnterCriticalSection(&lock);
+        pending = true;
+        sent = GetTickCount();
+        LeaveCriticalSection(&lock);
+
+        XNoOp(dpy);
+        XSync(dpy, False);
+
+        EnterCriticalSection(&lock);
+        bool done = lost;
+        pending = false;
+        if (!done)
+        {
+            last_rtt = GetTickCount() - sent;
+            if (last_rtt > max_rtt)
+                max_rtt = last_rtt;
+            total_rtt += last_rtt;
+            count++;
+        }
+        LeaveCriticalSection(&lock);
+        if (done)
+            break;
+    }
+
+    EnterCriticalSection(&lock);
+    if (closed)
+        lost = true;
+    LeaveCriticalSection(&lock);
+
+#ifndef HAVE_XSETIOERROREXITHANDLER
+    // Closing flushes the connection, which exits the process once it
+    // is broken, so the display is left behind then
+    if (closed)
+        return;
+#endif
+    XCloseDisplay(dpy);
+}
+
+bool CServerMonitor::Hung()
+{
+    EnterCriticalSection(&lock);
+    bool ret = pending && GetTickCount() - sent > threshold;
+    LeaveCriticalSection(&lock);
+    return ret;
+}
+
+void CServerMonitor::Stop()
+{
+    SetEvent(stop);
+}
+
+bool CServerMonitor::Wait(DWORD timeout)
+{
+    return WaitForSingleObject(thread, timeout) == WAIT_OBJECT_0;
+}
+
+void CServerMonitor::Report()
+{
+    EnterCriticalSection(&lock);
+    if (lost)
+        printf("Server connection lost\n");
+    if (count)
+        printf("Server round trip: last %lu ms, max %lu ms, mean %llu ms over %u requests\n",
+               (unsigned long)last_rtt, (unsigned long)max_rtt, total_rtt / count, count);
+    LeaveCriticalSection(&lock);
+}
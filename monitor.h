@@ -0,0 +1,71 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __MONITOR_H__
+#define __MONITOR_H__
+
+#include <windows.h>
+#include <X11/Xlib.h>
+
+/// @brief Watch over the responsiveness of a running X server.
+/// Takes ownership of a connection to the server and periodically measures
+/// the round trip time of an XNoOp/XSync pair on it from a background thread.
+class CServerMonitor
+{
+    private:
+        Display *dpy;
+        DWORD interval;
+        DWORD threshold;
+        HANDLE thread;
+        HANDLE stop;
+        CRITICAL_SECTION lock;
+        bool pending;           /// A round trip is in progress.
+        bool lost;              /// The connection to the server was lost.
+        DWORD sent;             /// Tick count when the pending round trip started.
+        DWORD last_rtt;
+        DWORD max_rtt;
+        unsigned long long total_rtt;
+        unsigned count;
+        static DWORD WINAPI ThreadProc(LPVOID param);
+        static void IOErrorExit(Display *dpy, void *data);
+        void Run();
+    public:
+        /// @brief Start monitoring.
+        /// @param dpy Connection to the server. Closed when monitoring stops.
+        /// @param interval Time between round trips, in ms.
+        /// @param threshold Time after which an unanswered round trip means
+        /// the server is hung, in ms.
+        CServerMonitor(Display *dpy, DWORD interval, DWORD threshold);
+        ~CServerMonitor();
+        /// @brief Check if the server failed to answer within the threshold.
+        bool Hung();
+        /// @brief Stop monitoring and close the connection.
+        void Stop();
+        /// @brief Wait for the monitor thread to finish after Stop().
+        /// @return true if the thread finished in time.
+        bool Wait(DWORD timeout);
+        /// @brief Print the round trip statistics.
+        void Report();
+};
+
+#endif
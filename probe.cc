@@ -0,0 +1,98 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "probe.h"
+
+#define X_TCP_PORT 6000
+#define X_UNIX_PATH "/tmp/.X11-unix/X"
+#define PROBE_REPLY_TIMEOUT 1000 /* ms */
+
+/// @brief Send a connection setup request and wait for the first reply byte.
+static bool Handshake(int fd)
+{
+    // xConnClientPrefix: LSB first, protocol 11.0, no authorization
+    static const unsigned char prefix[12] = { 'l', 0, 11, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    // A server closing the connection must not raise SIGPIPE in xlaunch
+    if (send(fd, prefix, sizeof(prefix), MSG_NOSIGNAL) != sizeof(prefix))
+        return false;
+
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, PROBE_REPLY_TIMEOUT) != 1)
+        return false;
+
+    // Failed, Success or Authenticate all mean the server is listening
+    unsigned char status;
+    if (read(fd, &status, 1) != 1)
+        return false;
+    return status <= 2;
+}
+
+static bool ProbeUnix(int display)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), X_UNIX_PATH "%d", display);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    bool ret = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && Handshake(fd);
+    close(fd);
+    return ret;
+}
+
+static bool ProbeTcp(int display)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(X_TCP_PORT + display);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    bool ret = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && Handshake(fd);
+    close(fd);
+    return ret;
+}
+
+bool ProbeDisplay(int display)
+{
+    return ProbeUnix(display) || ProbeTcp(display);
+}
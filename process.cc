@@ -0,0 +1,256 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include <stdio.h>
+#include <signal.h>
+#if defined (__CYGWIN__)
+#include <sys/cygwin.h>
+#endif
+#include "process.h"
+
+/* Time to wait for a window to handle the stop request, in ms */
+#define MESSAGE_TIMEOUT 1000
+
+/// @brief Send WM_ENDSESSION to all program windows.
+/// This will shutdown the started xserver
+static BOOL CALLBACK KillWindowsProc(HWND hwnd, LPARAM lParam)
+{
+    SendMessageTimeout(hwnd, WM_ENDSESSION, 0, 0, SMTO_ABORTIFHUNG, MESSAGE_TIMEOUT, NULL);
+    return TRUE;
+}
+
+/// @brief Ask all program windows to close.
+static BOOL CALLBACK CloseWindowsProc(HWND hwnd, LPARAM lParam)
+{
+    PostMessage(hwnd, WM_CLOSE, 0, 0);
+    return TRUE;
+}
+
+static void RequestStop(HANDLE process, DWORD threadId, StopMethod method)
+{
+    switch (method)
+    {
+        case StopByWindowMessage:
+            EnumThreadWindows(threadId, KillWindowsProc, 0);
+            break;
+        case StopBySignal:
+#if defined (__CYGWIN__)
+            {
+                pid_t pid = (pid_t)cygwin_internal(CW_WINPID_TO_CYGWIN_PID, GetProcessId(process));
+                if (pid > 0 && kill(pid, SIGTERM) == 0)
+                    break;
+            }
+#endif
+            EnumThreadWindows(threadId, CloseWindowsProc, 0);
+            break;
+    }
+}
+
+CProcessGroup::CProcessGroup(bool kill_on_close) : job(NULL), port(NULL)
+{
+    job = CreateJobObject(NULL, NULL);
+    if (job == NULL)
+        return;
+
+    if (kill_on_close)
+    {
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+        ZeroMemory(&limits, sizeof(limits));
+        limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+        SetInformationJobObject(job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+    }
+
+    // Get notified when the last process in the group exits
+    port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (port)
+    {
+        JOBOBJECT_ASSOCIATE_COMPLETION_PORT association;
+        association.CompletionKey = job;
+        association.CompletionPort = port;
+        if (!SetInformationJobObject(job, JobObjectAssociateCompletionPortInformation,
+                                     &association, sizeof(association)))
+        {
+            CloseHandle(port);
+            port = NULL;
+        }
+    }
+}
+
+CProcessGroup::~CProcessGroup()
+{
+    if (job)
+        CloseHandle(job);
+    if (port)
+        CloseHandle(port);
+}
+
+void CProcessGroup::Drain()
+{
+    DWORD message;
+    ULONG_PTR key;
+    LPOVERLAPPED overlapped;
+    while (port && GetQueuedCompletionStatus(port, &message, &key, &overlapped, 0))
+        ;
+}
+
+bool CProcessGroup::Add(HANDLE process, HANDLE thread)
+{
+    // A group emptied before, by Terminate() or its members exiting, has
+    // left notifications which would end the next Wait() at once
+    if (Active() == 0)
+        Drain();
+    // Fails if we are in a job which doesn't allow nesting (before Windows 8)
+    bool ret = job && AssignProcessToJobObject(job, process);
+    ResumeThread(thread);
+    return ret;
+}
+
+unsigned CProcessGroup::Active()
+{
+    JOBOBJECT_BASIC_ACCOUNTING_INFORMATION info;
+    if (job == NULL ||
+        !QueryInformationJobObject(job, JobObjectBasicAccountingInformation, &info, sizeof(info), NULL))
+        return 0;
+    return info.ActiveProcesses;
+}
+
+bool CProcessGroup::Wait(DWORD timeout)
+{
+    if (Active() == 0)
+        return true;
+    if (port == NULL)
+        return false;
+
+    DWORD start = GetTickCount();
+    for (;;)
+    {
+        DWORD elapsed = GetTickCount() - start;
+        if (timeout != INFINITE && elapsed >= timeout)
+            return false;
+
+        DWORD message;
+        ULONG_PTR key;
+        LPOVERLAPPED overlapped;
+        if (!GetQueuedCompletionStatus(port, &message, &key, &overlapped,
+                                       timeout == INFINITE ? INFINITE : timeout - elapsed))
+            return Active() == 0;
+        // Only the last notification counts, earlier ones may be left over
+        if (message == JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO && Active() == 0)
+            return true;
+    }
+}
+
+void CProcessGroup::Terminate()
+{
+    if (job)
+        TerminateJobObject(job, (UINT)-1);
+}
+
+StopResult StopProcess(HANDLE process, DWORD threadId, StopMethod method, DWORD grace,
+                       CProcessGroup *group)
+{
+    StopResult result;
+    ZeroMemory(&result, sizeof(result));
+
+    result.running = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    if (!result.running && (group == NULL || group->Active() == 0))
+        return result;
+
+    DWORD start = GetTickCount();
+    if (result.running)
+        RequestStop(process, threadId, method);
+    DWORD now = GetTickCount();
+    result.request = now - start;
+
+    // Give the process, and then the rest of its group, the grace period
+    DWORD remaining = result.request < grace ? grace - result.request : 0;
+    result.graceful = WaitForSingleObject(process, remaining) != WAIT_TIMEOUT;
+    if (result.graceful && group)
+    {
+        DWORD elapsed = GetTickCount() - start;
+        result.graceful = group->Wait(elapsed < grace ? grace - elapsed : 0);
+    }
+    result.wait = GetTickCount() - now;
+    if (result.graceful)
+        return result;
+
+    now = GetTickCount();
+    if (group)
+        group->Terminate();
+    TerminateProcess(process, (DWORD)-1);
+    WaitForSingleObject(process, INFINITE);
+    if (group)
+        group->Wait(MESSAGE_TIMEOUT);
+    result.kill = GetTickCount() - now;
+    return result;
+}
+
+void StopProcesses(const std::vector<PROCESS_INFORMATION> &processes, StopMethod method,
+                   DWORD grace, CProcessGroup *group)
+{
+    DWORD deadline = GetTickCount() + grace;
+    for (size_t i = 0; i < processes.size(); i++)
+        if (WaitForSingleObject(processes[i].hProcess, 0) == WAIT_TIMEOUT)
+            RequestStop(processes[i].hProcess, processes[i].dwThreadId, method);
+
+    // A wait takes a limited number of handles, so wait for them in chunks
+    bool graceful = true;
+    for (size_t first = 0; graceful && first < processes.size(); first += MAXIMUM_WAIT_OBJECTS)
+    {
+        HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+        DWORD count = 0;
+        for (size_t i = first; i < processes.size() && count < MAXIMUM_WAIT_OBJECTS; i++)
+            handles[count++] = processes[i].hProcess;
+        DWORD left = deadline - GetTickCount();
+        if ((LONG)left < 0)
+            left = 0;
+        graceful = WaitForMultipleObjects(count, handles, TRUE, left) != WAIT_TIMEOUT;
+    }
+    if (graceful && group)
+    {
+        DWORD left = deadline - GetTickCount();
+        graceful = group->Wait((LONG)left < 0 ? 0 : left);
+    }
+    if (graceful)
+        return;
+
+    if (group)
+        group->Terminate();
+    for (size_t i = 0; i < processes.size(); i++)
+        TerminateProcess(processes[i].hProcess, (DWORD)-1);
+    for (size_t i = 0; i < processes.size(); i++)
+        WaitForSingleObject(processes[i].hProcess, MESSAGE_TIMEOUT);
+}
+
+void ReportStop(const char *name, const StopResult &result)
+{
+    if (!result.running && result.wait == 0 && result.kill == 0)
+        printf("%s had already exited\n", name);
+    else if (result.graceful)
+        printf("%s stopped after %lu ms (request %lu ms)\n", name,
+               (unsigned long)(result.request + result.wait), (unsigned long)result.request);
+    else
+        printf("%s didn't stop within %lu ms, terminated in %lu ms\n", name,
+               (unsigned long)(result.request + result.wait), (unsigned long)result.kill);
+}
@@ -0,0 +1,98 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __PROCESS_H__
+#define __PROCESS_H__
+
+#include <windows.h>
+#include <vector>
+
+/// @brief How a process is asked to stop before it is terminated.
+enum StopMethod
+{
+    StopByWindowMessage,    /// Send WM_ENDSESSION to the windows of its main thread.
+    StopBySignal            /// Send SIGTERM, or WM_CLOSE where there are no signals.
+};
+
+/// @brief How long each stage of stopping a process took, in ms.
+struct StopResult
+{
+    bool running;           /// The process was still running.
+    bool graceful;          /// The process exited within the grace period.
+    DWORD request;          /// Time to deliver the stop request.
+    DWORD wait;             /// Time waited for the process to exit.
+    DWORD kill;             /// Time to terminate the process, if needed.
+};
+
+/// @brief A process and all its descendants, supervised as a unit.
+/// Backed by a job object, so descendants are found and terminated even
+/// after the process which started them has exited.
+class CProcessGroup
+{
+    private:
+        HANDLE job;
+        HANDLE port;
+        /// @brief Discard the notifications queued on the completion port.
+        void Drain();
+    public:
+        /// @param kill_on_close Terminate the remaining members when the
+        /// group is destroyed, or xlaunch exits.
+        CProcessGroup(bool kill_on_close);
+        ~CProcessGroup();
+        /// @brief Add a process to the group and resume it.
+        /// The process must have been created with CREATE_SUSPENDED, so it
+        /// can't start children before it is in the group.
+        /// @return false if the process could only be resumed.
+        bool Add(HANDLE process, HANDLE thread);
+        /// @brief Number of processes in the group still running.
+        unsigned Active();
+        /// @brief Wait until all processes in the group have exited.
+        /// @return true if they did within the timeout.
+        bool Wait(DWORD timeout);
+        /// @brief Terminate all processes in the group.
+        /// The group can be reused, processes added afterwards start a new
+        /// round for Wait().
+        void Terminate();
+};
+
+/// @brief Stop a process, escalating to termination.
+/// Asks the process to stop, waits up to grace ms for it to exit and
+/// terminates it if it did not. If the process has a group, the rest of the
+/// group gets what remains of the grace period, before it is terminated.
+/// @param process Handle of the process.
+/// @param threadId Id of its main thread.
+/// @param group Group of the process, or NULL.
+StopResult StopProcess(HANDLE process, DWORD threadId, StopMethod method, DWORD grace,
+                       CProcessGroup *group = NULL);
+
+/// @brief Stop several processes at once, sharing one grace period.
+/// All of them are asked to stop first, then they and the rest of the group
+/// get the grace period to exit, before whatever is left is terminated.
+/// @param group Group of the processes, or NULL.
+void StopProcesses(const std::vector<PROCESS_INFORMATION> &processes, StopMethod method,
+                   DWORD grace, CProcessGroup *group = NULL);
+
+/// @brief Print how stopping a process went.
+void ReportStop(const char *name, const StopResult &result);
+
+#endif
@@ -35,6 +35,7 @@
 #define IDD_FONTPATH            106
 #define IDD_EXTRA               107
 #define IDD_ABOUT               108
+#define IDD_MORECLIENTS         109
 
 #define IDC_MULTIWINDOW         200
 #define IDC_WINDOWED            201
@@ -92,6 +93,11 @@
 #define IDC_DISABLEAC_DESC       269
 #define IDC_XDMCP_TERMINATE      270
 
+#define IDC_MORECLIENTS_DESC     280
+#define IDC_MORECLIENTS          281
+#define IDC_AUTOSTART            282
+#define IDC_AUTOSTART_DESC       283
+
 #define IDS_DISPLAY_TITLE             300
 #define IDS_DISPLAY_SUBTITLE          301
 #define IDS_CLIENTS_TITLE             302
@@ -106,6 +112,8 @@
 #define IDS_FINISH_SUBTITLE           311
 #define IDS_EXTRA_TITLE               312
 #define IDS_EXTRA_SUBTITLE            313
+#define IDS_MORECLIENTS_TITLE         314
+#define IDS_MORECLIENTS_SUBTITLE      315
 #define IDS_SAVE_TITLE                320
 #define IDS_SAVE_FILETITLE            321
 #define IDS_SAVE_FILTER               322
@@ -115,6 +123,7 @@
 #define IDS_XDMCP_CAPTION             326
 #define IDS_EXTRA_CAPTION             327
 #define IDS_FINISH_CAPTION            328
+#define IDS_MORECLIENTS_CAPTION       329
 
 #define IDI_XLAUNCH		400
 #define IDI_XLAUNCH_DOCUMENT	401
@@ -0,0 +1,1116 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <deque>
+#include "session.h"
+#include "window/util.h"
+#include "probe.h"
+#include "monitor.h"
+#include "trace.h"
+#include "stats.h"
+#include "metrics.h"
+#include "process.h"
+#include "launchspawn.h"
+#include "envcache.h"
+#include "autostart.h"
+#include "watch.h"
+
+#include <X11/Xlib.h>
+
+#ifdef _DEBUG
+bool debug = true;
+#else
+bool debug = false;
+#endif
+
+extern char **environ;
+
+/// @brief Wait for the X server to write its display number to -displayfd.
+/// The server writes it once it is ready to accept connections.
+/// @return 0 if the server reported readiness, 1 if the pipe was closed.
+static DWORD WINAPI DisplayFdReader(LPVOID param)
+{
+    char c;
+    DWORD count;
+    if (ReadFile((HANDLE)param, &c, 1, &count, NULL) && count == 1)
+        return 0;
+    return 1;
+}
+
+CSession::CSession(const CConfig &config, const std::string &name, const std::string &metricsfile,
+                   bool perdisplay) :
+    config(config), name(name), metricsfile(metricsfile), thread(NULL), stop(NULL),
+    replace(NULL), watched(config), watch(NULL), nodisplayfd(false), configrestart(false), failed(false)
+{
+    // The display is reserved for as long as the session lasts, restarts included
+    if (config.display == "auto")
+    {
+        char number[16];
+        snprintf(number, sizeof(number), "%u", lease.Acquire());
+        this->config.display = number;
+    }
+    else if (!config.display.empty() &&
+             config.display.str().find_first_not_of("0123456789") == std::string::npos)
+        lease.Reserve(atoi(config.display.c_str()));
+    if (perdisplay && !metricsfile.empty())
+        this->metricsfile = SessionMetricsFile(metricsfile, this->config.display);
+
+    stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (stop == NULL)
+        throw win32_error("CreateEvent failed");
+    replace = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (replace == NULL)
+    {
+        DWORD err = GetLastError();
+        CloseHandle(stop);
+        throw win32_error("CreateEvent failed", err);
+    }
+    InitializeCriticalSection(&lock);
+}
+
+CSession::~CSession()
+{
+    // Nothing of a session may still run when xlaunch's exit handlers do
+    if (thread)
+    {
+        Stop();
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+    }
+    CloseHandle(stop);
+    CloseHandle(replace);
+    DeleteCriticalSection(&lock);
+    delete watch;
+}
+
+DWORD WINAPI CSession::ThreadProc(LPVOID param)
+{
+    CSession *session = (CSession *)param;
+    try {
+        session->Run();
+    } catch (std::runtime_error &e)
+    {
+        printf("Error: %s\n", e.what());
+        session->failed = true;
+    }
+    return 0;
+}
+
+/// @brief Pacing of restarts by the restart policy of a configuration.
+/// Restarts are delayed exponentially and randomized to between half and
+/// all of the delay, so sessions failing for a common reason don't all come
+/// back at once. The delay starts over after a run of at least the restart
+/// window, and restarts stop when there were too many within the window.
+class CBackoff
+{
+    private:
+        const CConfig &config;
+        std::deque<DWORD> restarts;
+        DWORD delay;
+        unsigned seed;
+    public:
+        CBackoff(const CConfig &config) :
+            config(config), delay(config.restart_delay),
+            seed(GetTickCount() ^ GetCurrentThreadId())
+        {
+        }
+        /// @brief Check if the policy restarts after a run which ended.
+        bool Wanted(bool failed)
+        {
+            return config.restart == CConfig::RestartAlways ||
+                (config.restart == CConfig::RestartOnFailure && failed);
+        }
+        /// @brief Get the delay before the next restart.
+        /// @param ran How long the run which ended took, in ms.
+        /// @return false if restarted too often.
+        bool Next(DWORD ran, DWORD &wait)
+        {
+            DWORD window = config.restart_window * 1000;
+            DWORD now = GetTickCount();
+            if (ran > window)
+                delay = config.restart_delay;
+            while (!restarts.empty() && now - restarts.front() > window)
+                restarts.pop_front();
+            if (config.restart_limit && restarts.size() >= config.restart_limit)
+                return false;
+            restarts.push_back(now);
+
+            seed = seed * 1103515245 + 12345;
+            wait = delay / 2 + (seed >> 8) % (delay / 2 + 1);
+            delay = delay * 2 < config.restart_max_delay ? delay * 2 : config.restart_max_delay;
+            return true;
+        }
+};
+
+void CSession::Run()
+{
+    // Watched from before the first launch until the session ends, so
+    // changes while the server starts or waits to restart aren't missed
+    if (!watchfile.empty() && watch == NULL)
+    {
+        watch = new CFileWatch(watchfile);
+        if (!watch->Handle())
+            printf("Can't watch %s for changes\n", watchfile.c_str());
+    }
+
+    CBackoff backoff(config);
+    for (;;)
+    {
+        std::string cause;
+        bool failed;
+        DWORD started = GetTickCount();
+        try {
+            failed = Launch(cause);
+        } catch (std::runtime_error &e)
+        {
+            if (config.restart == CConfig::RestartNever || Stopping())
+                throw;
+            cause = e.what();
+            failed = true;
+        }
+
+        // A changed configuration is applied right away, whatever the policy
+        if (configrestart && !Stopping())
+        {
+            configrestart = false;
+            printf("Restarting X server :%s, %s\n", config.display.c_str(), cause.c_str());
+            CTrace::Instant("Restart");
+            continue;
+        }
+
+        if (Stopping() || !backoff.Wanted(failed))
+            return;
+
+        DWORD wait;
+        if (!backoff.Next(GetTickCount() - started, wait))
+        {
+            char buffer[128];
+            snprintf(buffer, sizeof(buffer), "X server :%s restarted %u times within %u seconds, last ",
+                     config.display.c_str(), config.restart_limit, config.restart_window);
+            throw std::runtime_error(buffer + cause);
+        }
+        printf("Restarting X server :%s in %lu ms, %s\n", config.display.c_str(),
+               (unsigned long)wait, cause.c_str());
+        CTrace::Instant("Restart");
+        if (WaitForSingleObject(stop, wait) != WAIT_TIMEOUT)
+            return;
+    }
+}
+
+void CSession::Start()
+{
+    thread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+    if (thread == NULL)
+        throw win32_error("CreateThread failed");
+}
+
+bool CSession::Join()
+{
+    if (thread)
+        WaitForSingleObject(thread, INFINITE);
+    return !failed;
+}
+
+void CSession::Stop()
+{
+    SetEvent(stop);
+}
+
+bool CSession::ReplaceClient(const std::string &program)
+{
+    EnterCriticalSection(&lock);
+    bool keep = config.keep_server;
+    if (keep)
+        pendingprogram = program;
+    LeaveCriticalSection(&lock);
+    if (keep)
+        SetEvent(replace);
+    return keep;
+}
+
+bool CSession::Stopping()
+{
+    return WaitForSingleObject(stop, 0) == WAIT_OBJECT_0;
+}
+
+bool CSession::Finished()
+{
+    return thread == NULL || WaitForSingleObject(thread, 0) == WAIT_OBJECT_0;
+}
+
+std::string SessionMetricsFile(const std::string &filename, const std::string &display)
+{
+    if (filename.empty())
+        return filename;
+    size_t dot = filename.rfind('.');
+    size_t slash = filename.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = filename.size();
+    return filename.substr(0, dot) + "-" + display + filename.substr(dot);
+}
+
+/// @brief Open a connection to the server, tracing the attempt.
+Display *CSession::OpenDisplay(std::string &display)
+{
+    CTraceScope trace("XOpenDisplay");
+    Display *xd = XOpenDisplay(display.c_str());
+    if (xd)
+        CTrace::Instant("Connected");
+    return xd;
+}
+
+/// @brief Try to connect to server.
+/// If the server was given a -displayfd pipe, wait until it reports
+/// that it is ready to accept connections. Otherwise, or if the server
+/// closes the pipe without reporting, probe the display with an
+/// increasing delay until successful, server died or the configured
+/// timeout expired. A server which dies before reporting is started again
+/// without -displayfd by Launch().
+Display *CSession::WaitForServer(HANDLE serverProcess, HANDLE readyPipe, std::string &display)
+{
+    DWORD   timeout = config.server_timeout * 1000;
+    DWORD   start = GetTickCount();
+    DWORD   delay = PROBE_MIN_DELAY;
+    int     number = atoi(config.display.c_str());
+    Display *xd;
+
+    if (readyPipe != NULL)
+    {
+        HANDLE reader = CreateThread(NULL, 0, DisplayFdReader, readyPipe, 0, NULL);
+        if (reader != NULL)
+        {
+            HANDLE waits[3] = { reader, serverProcess, stop };
+            DWORD status = 1;
+            CTrace::Begin("Wait for -displayfd");
+            DWORD ret = WaitForMultipleObjects(3, waits, FALSE, timeout);
+            CTrace::End("Wait for -displayfd");
+            if (ret == WAIT_OBJECT_0)
+                GetExitCodeThread(reader, &status);
+            else
+            {
+                CancelSynchronousIo(reader);
+                WaitForSingleObject(reader, INFINITE);
+            }
+            CloseHandle(reader);
+
+            // Server died or did not become ready in time
+            if (ret != WAIT_OBJECT_0)
+                return NULL;
+
+            if (status == 0 && (xd = OpenDisplay(display)))
+                return xd;
+
+            if (debug)
+                printf("Server did not report readiness on -displayfd, polling\n");
+        }
+    }
+
+    for (;;)
+    {
+        // Only pay for a full Xlib connection once the server answers
+        CTrace::Begin("Probe display");
+        bool answered = ProbeDisplay(number);
+        CTrace::End("Probe display");
+        if (answered && (xd = OpenDisplay(display)))
+            return xd;
+
+        DWORD elapsed = GetTickCount() - start;
+        if (elapsed >= timeout)
+            break;
+        if (delay > timeout - elapsed)
+            delay = timeout - elapsed;
+        HANDLE waits[2] = { serverProcess, stop };
+        if (WaitForMultipleObjects(2, waits, FALSE, delay) != WAIT_TIMEOUT)
+            break;
+        if (delay < PROBE_MAX_DELAY)
+            delay = (delay * 2 < PROBE_MAX_DELAY) ? delay * 2 : PROBE_MAX_DELAY;
+    }
+    return NULL;
+}
+
+/// @brief Start the X server in its process group.
+/// @param args Command line of the server.
+/// @param displayfd Have the server report readiness, unless a server of
+/// this session rejected that before.
+/// @param readyPipe Receives the pipe to pass to WaitForServer(), or NULL.
+/// @throws win32_error if it can't be started.
+void CSession::StartServer(const std::vector<std::string> &args, bool displayfd, SpawnRequest &request,
+                           PROCESS_INFORMATION &pi, CProcessGroup &group, HANDLE &readyPipe)
+{
+    HANDLE readyWrite = NULL;
+    readyPipe = NULL;
+    request.argv = args;
+    request.stdio[1] = SPAWN_INHERIT;
+    request.suspended = true;
+
+#if defined (__CYGWIN__)
+    // Have the server tell us when it is ready, rather than polling.
+    // The write end of the pipe becomes the server's stdout.
+    if (displayfd && !nodisplayfd)
+    {
+        SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+        if (CreatePipe(&readyPipe, &readyWrite, &sa, 0))
+        {
+            SetHandleInformation(readyPipe, HANDLE_FLAG_INHERIT, 0);
+            request.argv.push_back("-displayfd");
+            request.argv.push_back("1");
+            request.stdio[1] = readyWrite;
+        }
+        else
+            readyPipe = readyWrite = NULL;
+    }
+#endif
+
+    if (debug)
+      printf("Server: %s\n", JoinCommandLine(request.argv).c_str());
+
+    try
+    {
+        Spawn(request, pi);
+    }
+    catch (...)
+    {
+        if (readyPipe)
+        {
+            CloseHandle(readyPipe);
+            CloseHandle(readyWrite);
+            readyPipe = NULL;
+        }
+        throw;
+    }
+    if (!group.Add(pi.hProcess, pi.hThread) && debug)
+        printf("Can't supervise descendants of the X server\n");
+
+    // Only the server may hold the write end, so we see it closing
+    if (readyWrite)
+        CloseHandle(readyWrite);
+}
+
+/// @brief Start the client in a process group of its own.
+/// @throws win32_error if it can't be started.
+void CSession::StartClient(SpawnRequest &request, PROCESS_INFORMATION &pic, CProcessGroup *&group)
+{
+    request.suspended = true;
+    Spawn(request, pic);
+    group = new CProcessGroup(true);
+    if (!group->Add(pic.hProcess, pic.hThread) && debug)
+        printf("Can't supervise descendants of the client\n");
+}
+
+/// @brief Build the command line and environment of a client.
+/// @param local Start the client here, or on the remote host.
+/// @param argv Receives the arguments.
+/// @param show Set if the console window of the client should be shown.
+void CSession::ClientCommand(const std::string &display, bool local, const std::string &program,
+                             std::vector<std::string> &argv, std::vector<std::string> &env,
+                             bool &show)
+{
+    argv.clear();
+    env.clear();
+    show = false;
+    if (!local)
+    {
+        std::string host = config.host;
+        if (!config.user.empty())
+            host = config.user + "@" + config.host;
+
+        if (config.protocol == "ssh")
+          {
+            if (config.terminal)
+              {
+                show = true;
+                argv.push_back("mintty");
+                argv.push_back("-e");
+              }
+
+            std::vector<std::string> ssh;
+            ssh.push_back("ssh");
+            ssh.push_back("-Y");
+            ssh.push_back(host);
+            SplitArguments(config.extra_ssh, ssh);
+            ssh.push_back(program);
+
+            if (config.keychain)
+              {
+                argv.push_back("bash");
+                argv.push_back("-c");
+                argv.push_back(". ~/.keychain/$HOSTNAME-sh ; " + JoinShellCommand(ssh));
+              }
+            else
+                argv.insert(argv.end(), ssh.begin(), ssh.end());
+          }
+        else if (config.protocol == "rsh")
+          {
+            argv.push_back("rsh");
+            if (!config.user.empty())
+              {
+                argv.push_back("-l");
+                argv.push_back(config.user);
+              }
+            argv.push_back(config.host);
+            argv.push_back(program);
+          }
+    } else {
+#if defined (__CYGWIN__)
+      // With a cached login environment, skip the profile scripts, and
+      // the shell too when the program is a plain binary found in its PATH
+      bool cached = config.cache_login_env && LoginEnvironment(env);
+      std::string path;
+      for (size_t i = 0; cached && i < env.size(); i++)
+          if (env[i].compare(0, 5, "PATH=") == 0)
+              path = env[i].substr(5);
+      if (!cached || !SplitPlainCommand(program, argv) || !FindProgram(argv[0], path, argv[0]))
+      {
+          argv.clear();
+          argv.push_back("bash");
+          if (!cached)
+              argv.push_back("-l");
+          argv.push_back("-c");
+          argv.push_back(program);
+      }
+#elif defined (__MINGW__)
+      SplitCommandLine(program, argv);
+#else
+#error "Don't know how to start child process on target"
+#endif
+    }
+
+    if (argv.empty())
+        return;
+
+    // Set DISPLAY for the client only, other sessions have their own
+    if (env.empty())
+        for (char **entry = environ; *entry; entry++)
+            if (strncmp(*entry, "DISPLAY=", 8) != 0)
+                env.push_back(*entry);
+    env.push_back("DISPLAY=" + display);
+}
+
+/// @brief Get the programs to start alongside the client.
+void CSession::MoreClients(std::vector<CClientEntry> &extras)
+{
+    extras = config.clients;
+    if (config.autostart)
+    {
+        std::vector<std::string> programs;
+        AutostartPrograms(programs);
+        for (size_t i = 0; i < programs.size(); i++)
+            extras.push_back(CClientEntry(true, programs[i]));
+    }
+}
+
+/// @brief Start the programs alongside the client.
+/// They run until the session ends, but don't end it themselves.
+/// @param procs Receives the processes which could be started.
+void CSession::StartMoreClients(const std::string &display, const std::vector<CClientEntry> &extras,
+                                CProcessGroup &group, std::vector<PROCESS_INFORMATION> &procs)
+{
+    for (size_t i = 0; i < extras.size(); i++)
+    {
+        SpawnRequest request;
+        ClientCommand(display, extras[i].local, extras[i].program,
+                      request.argv, request.env, request.show);
+        if (request.argv.empty())
+            continue;
+        if (debug)
+          printf("Client: %s\n", JoinCommandLine(request.argv).c_str());
+        request.suspended = true;
+        PROCESS_INFORMATION info;
+        try
+        {
+            Spawn(request, info);
+        }
+        catch (std::runtime_error &e)
+        {
+            printf("Can't start %s: %s\n", extras[i].program.c_str(), e.what());
+            continue;
+        }
+        group.Add(info.hProcess, info.hThread);
+        procs.push_back(info);
+    }
+}
+
+/// @brief Stop the programs started alongside the client, sharing one
+/// grace period between all of them, and let go of them.
+void CSession::StopMoreClients(std::vector<PROCESS_INFORMATION> &procs, CProcessGroup &group, DWORD grace)
+{
+    StopProcesses(procs, StopBySignal, grace, &group);
+    // Descendants left behind by programs which exited go too
+    group.Terminate();
+    for (size_t i = 0; i < procs.size(); i++)
+    {
+        CloseHandle(procs[i].hProcess);
+        CloseHandle(procs[i].hThread);
+    }
+    procs.clear();
+}
+
+/// @brief Read the watched file again and take over what changed.
+/// The display stays, the session holds it until it ends.
+/// @param scope Receives what has to start again for the changes to take effect.
+/// @return false if nothing changed, or the file can't be used.
+bool CSession::Reload(CConfigField::Scope &scope)
+{
+    CConfig loaded;
+    std::vector<CConfigProblem> problems;
+    if (loaded.Load(watchfile.c_str(), &problems))
+        loaded.Validate(problems);
+    // Warnings, like attributes of other versions, don't stop the first
+    // load either
+    for (size_t i = 0; i < problems.size(); i++)
+    {
+        if (problems[i].warning)
+        {
+            if (debug)
+                printf("Reloading %s: %s: %s\n", watchfile.c_str(), problems[i].field.c_str(),
+                       problems[i].message.c_str());
+            continue;
+        }
+        // Keep running what we have, the file may well be fixed soon
+        printf("Not reloading %s: %s%s%s\n", watchfile.c_str(), problems[i].field.c_str(),
+               problems[i].field.empty() ? "" : ": ", problems[i].message.c_str());
+        return false;
+    }
+
+    if (loaded.display != watched.display)
+    {
+        printf("Display of X server :%s can't change while it runs\n", config.display.c_str());
+        loaded.display = watched.display;
+    }
+    if (!ConfigChanged(watched, loaded, scope))
+        return false;
+    watched = loaded;
+
+    loaded.display = config.display;
+    EnterCriticalSection(&lock);
+    config = loaded;
+    LeaveCriticalSection(&lock);
+    printf("Reloaded %s\n", watchfile.c_str());
+    return true;
+}
+
+/// @brief Start X server and clients and wait until they exit.
+/// @param cause Receives a description of why the launch ended.
+/// @return true if the launch ended by a failure.
+bool CSession::Launch(std::string &cause)
+{
+    CTraceScope trace("Launch");
+
+    // Start with what changed while waiting to restart
+    CConfigField::Scope changed;
+    if (watch && watch->Changed())
+        Reload(changed);
+
+    CLaunchStats stats(name);
+    std::vector<std::string> server;
+    std::vector<std::string> client;
+    std::vector<std::string> clientenv;
+    bool showconsole = false;
+
+    stats.Begin("Build command line");
+
+    // Construct display strings
+    std::string display_id = ":" + config.display;
+    std::string display = display_id + ".0";
+
+    // Build X server arguments
+#if defined (__CYGWIN__)
+    server.push_back("XWin");
+#elif defined (__MINGW__)
+    server.push_back("Xming");
+#else
+#error "Don't know X server name"
+#endif
+    server.push_back(display_id);
+    switch (config.window)
+    {
+        case CConfig::MultiWindow:
+            server.push_back("-multiwindow");
+            break;
+        case CConfig::Fullscreen:
+            server.push_back("-fullscreen");
+            break;
+        case CConfig::Nodecoration:
+            server.push_back("-nodecoration");
+            break;
+        default:
+            break;
+    }
+    // Add XDMCP parameter
+    if (config.client == CConfig::XDMCP)
+    {
+        if (config.broadcast)
+            server.push_back("-broadcast");
+        else
+        {
+            if (config.indirect)
+                server.push_back("-indirect");
+            else
+                server.push_back("-query");
+            server.push_back(config.xdmcp_host);
+        }
+        if (config.xdmcpterminate)
+            server.push_back("-terminate");
+    }
+    server.push_back(config.clipboard ? "-clipboard" : "-noclipboard");
+    server.push_back(config.wgl ? "-wgl" : "-nowgl");
+    if (config.disableac)
+        server.push_back("-ac");
+    SplitArguments(config.extra_params, server);
+
+    if (config.client == CConfig::StartProgram)
+        ClientCommand(display, config.local, config.local ? config.localprogram : config.remoteprogram,
+                      client, clientenv, showconsole);
+
+    // More programs, started alongside the client
+    std::vector<CClientEntry> extras;
+    MoreClients(extras);
+    stats.End("Build command line");
+
+    // Prepare program startup
+    SpawnRequest serverspawn, clientspawn;
+    PROCESS_INFORMATION pi, pic;
+    HANDLE handles[5];
+    DWORD hcount = 0;
+    Display *dpy = NULL;
+    CServerMonitor *monitor = NULL;
+    CResourceMetrics *metrics = NULL;
+    // Descendants of the server and client are torn down with them.
+    // A server left running for a remote client must survive us.
+    CProcessGroup servergroup(config.local), extragroup(config.local);
+    CProcessGroup *clientgroup = NULL;
+    std::vector<PROCESS_INFORMATION> extraprocs;
+    bool hungkill = false;
+    HANDLE readyRead = NULL;
+
+    ZeroMemory( &pi, sizeof(pi) );
+    ZeroMemory( &pic, sizeof(pic) );
+
+    // Start X server process
+    stats.Begin("Start server");
+    try
+    {
+        StartServer(server, !client.empty() || !extras.empty(), serverspawn, pi, servergroup,
+                    readyRead);
+    }
+    catch (...)
+    {
+        stats.End("Start server");
+        throw;
+    }
+    stats.End("Start server");
+    handles[hcount++] = pi.hProcess;
+
+    if (!metricsfile.empty())
+    {
+        metrics = new CResourceMetrics(metricsfile, display_id);
+        metrics->AddProcess("server", pi.hProcess);
+    }
+
+    if (!client.empty() || !extras.empty())
+    {
+        // Wait for server to startup
+        stats.Begin("WaitForServer");
+        dpy = WaitForServer(pi.hProcess, readyRead, display);
+        bool displayfd = readyRead != NULL;
+        if (readyRead)
+            CloseHandle(readyRead);
+
+        // A server which doesn't know -displayfd exits right away, as it
+        // does for other bad options. Try once more without it and poll.
+        if (dpy == NULL && displayfd && !Stopping() &&
+            WaitForSingleObject(pi.hProcess, 0) == WAIT_OBJECT_0)
+        {
+            printf("X server %s exited before reporting readiness, starting it without -displayfd\n",
+                   display_id.c_str());
+            if (metrics)
+                metrics->RemoveProcess(pi.hProcess);
+            CloseHandle(pi.hProcess);
+            CloseHandle(pi.hThread);
+            hcount = 0;
+            try
+            {
+                StartServer(server, false, serverspawn, pi, servergroup, readyRead);
+            }
+            catch (...)
+            {
+                stats.End("WaitForServer");
+                delete metrics;
+                throw;
+            }
+            handles[hcount++] = pi.hProcess;
+            if (metrics)
+                metrics->AddProcess("server", pi.hProcess);
+            dpy = WaitForServer(pi.hProcess, NULL, display);
+            // Only a server which came up without it is known not to take it
+            if (dpy)
+                nodisplayfd = true;
+        }
+        stats.End("WaitForServer");
+        if (dpy == NULL)
+        {
+            bool stopping = Stopping();
+            if (WaitForSingleObject(pi.hProcess, 0) == WAIT_OBJECT_0)
+                stats.SetOutcome(CLaunchStats::ServerDied);
+            else if (!stopping)
+                stats.SetOutcome(CLaunchStats::Timeout);
+            while (hcount--)
+                TerminateProcess(handles[hcount], (DWORD)-1);
+            delete metrics;
+            if (stopping)
+            {
+                cause = "stopped";
+                return false;
+            }
+            throw std::runtime_error("Connection to server failed");
+        }
+
+        // Start the child process, hiding its console unless asked to show it
+        if (!client.empty())
+        {
+            if (debug)
+              printf("Client: %s\n", JoinCommandLine(client).c_str());
+
+            stats.Begin("Start client");
+            clientspawn.argv = client;
+            clientspawn.env = clientenv;
+            clientspawn.show = showconsole;
+            try
+            {
+                StartClient(clientspawn, pic, clientgroup);
+            }
+            catch (...)
+            {
+                stats.End("Start client");
+                stats.SetOutcome(CLaunchStats::ClientFailed);
+                while (hcount--)
+                    TerminateProcess(handles[hcount], (DWORD)-1);
+                XCloseDisplay(dpy);
+                delete metrics;
+                throw;
+            }
+            stats.End("Start client");
+            handles[hcount++] = pic.hProcess;
+            if (metrics)
+                metrics->AddProcess("client", pic.hProcess);
+        }
+
+        // Start the other programs right away too
+        if (!extras.empty())
+        {
+            stats.Begin("Start more clients");
+            StartMoreClients(display, extras, extragroup, extraprocs);
+            stats.End("Start more clients");
+        }
+
+        // Keep our connection to check on the server
+        if (config.monitor_interval)
+            monitor = new CServerMonitor(dpy, config.monitor_interval * 1000, config.hung_timeout * 1000);
+        else
+            XCloseDisplay(dpy);
+    }
+
+    // Wait until any child process exits, checking the server and
+    // sampling resource usage meanwhile
+    DWORD timeout = monitor ? config.monitor_interval * 1000 : INFINITE;
+    if (metrics && timeout > METRICS_INTERVAL)
+        timeout = METRICS_INTERVAL;
+    DWORD ret;
+    bool hung = false;
+    // With KeepServer, a client which ended is started again after a delay
+    CBackoff clientbackoff(config);
+    bool clientpending = false;
+    DWORD clientdue = 0, clientstarted = GetTickCount();
+    // Changes to the file are picked up while waiting, including those
+    // made while the server started
+    stats.Begin("Session");
+    if (metrics)
+        metrics->Sample();
+    for (;;)
+    {
+        // Also wake up when asked to stop or to replace the client, or the
+        // file changed, without counting these as processes
+        handles[hcount] = stop;
+        handles[hcount + 1] = replace;
+        DWORD nhandles = hcount + 2;
+        if (watch && watch->Handle())
+            handles[nhandles++] = watch->Handle();
+        DWORD wait = timeout;
+        if (clientpending)
+        {
+            DWORD left = clientdue - GetTickCount();
+            if ((int)left < 0)
+                left = 0;
+            if (left < wait)
+                wait = left;
+        }
+        ret = WaitForMultipleObjects(nhandles, handles, FALSE, wait);
+
+        if (ret == WAIT_TIMEOUT)
+        {
+            if (clientpending && (int)(GetTickCount() - clientdue) >= 0)
+            {
+                clientpending = false;
+                CTraceScope trace("Restart client");
+                try
+                {
+                    StartClient(clientspawn, pic, clientgroup);
+                }
+                catch (std::runtime_error &e)
+                {
+                    cause = std::string("client could not be restarted, ") + e.what();
+                    break;
+                }
+                clientstarted = GetTickCount();
+                handles[hcount++] = pic.hProcess;
+                if (metrics)
+                    metrics->AddProcess("client", pic.hProcess);
+            }
+            if (metrics)
+                metrics->Sample();
+            if (!monitor || monitor->Hung() == hung)
+                continue;
+            hung = !hung;
+            if (!hung)
+            {
+                printf("X server %s is responding again\n", display_id.c_str());
+                continue;
+            }
+            printf("X server %s is not responding\n", display_id.c_str());
+            if (config.restart != CConfig::RestartNever)
+            {
+                TerminateProcess(pi.hProcess, (DWORD)-1);
+                hungkill = true;
+                break;
+            }
+            continue;
+        }
+
+        // Only the client ending or being replaced keeps the server going
+        bool clientexit = hcount > 1 && ret == WAIT_OBJECT_0 + 1;
+        bool replacing = ret == WAIT_OBJECT_0 + hcount + 1;
+        bool reloading = false;
+        if (ret == WAIT_OBJECT_0 + hcount + 2)
+        {
+            CConfigField::Scope scope;
+            if (!watch->Changed() || !Reload(scope) || scope == CConfigField::Session)
+                continue;
+            if (scope == CConfigField::Server)
+            {
+                cause = "configuration changed";
+                configrestart = true;
+                break;
+            }
+            reloading = true;
+        }
+        if (!reloading && (!config.keep_server || !(clientexit || replacing)))
+            break;
+
+        std::string clientcause;
+        bool failed = false;
+        if (replacing || reloading)
+        {
+            EnterCriticalSection(&lock);
+            if (replacing && !pendingprogram.empty())
+                (config.local ? config.localprogram : config.remoteprogram) = pendingprogram;
+            pendingprogram.clear();
+            LeaveCriticalSection(&lock);
+            if (config.client == CConfig::StartProgram)
+                ClientCommand(display, config.local,
+                              config.local ? config.localprogram : config.remoteprogram,
+                              client, clientenv, showconsole);
+            clientspawn.argv = client;
+            clientspawn.env = clientenv;
+            clientspawn.show = showconsole;
+            clientcause = replacing ? "client replaced" : "configuration changed";
+            if (hcount > 1)
+                StopProcess(pic.hProcess, pic.dwThreadId, StopBySignal,
+                            config.shutdown_timeout * 1000, clientgroup);
+            if (reloading)
+            {
+                StopMoreClients(extraprocs, extragroup, config.shutdown_timeout * 1000);
+                MoreClients(extras);
+                StartMoreClients(display, extras, extragroup, extraprocs);
+            }
+        }
+        else
+        {
+            DWORD code = 0;
+            GetExitCodeProcess(pic.hProcess, &code);
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "client exited with status %lu", (unsigned long)code);
+            clientcause = buffer;
+            failed = code != 0;
+        }
+
+        // Let go of the old client
+        if (hcount > 1)
+        {
+            if (metrics)
+            {
+                metrics->Sample(true);
+                metrics->RemoveProcess(pic.hProcess);
+            }
+            CloseHandle(pic.hProcess);
+            CloseHandle(pic.hThread);
+            ZeroMemory(&pic, sizeof(pic));
+            delete clientgroup;
+            clientgroup = NULL;
+            hcount = 1;
+        }
+
+        if (client.empty())
+            continue;
+        DWORD delay = 0;
+        if (!replacing && !reloading)
+        {
+            if (!clientbackoff.Wanted(failed))
+            {
+                printf("X server %s keeps running without client, %s\n", display_id.c_str(),
+                       clientcause.c_str());
+                continue;
+            }
+            if (!clientbackoff.Next(GetTickCount() - clientstarted, delay))
+            {
+                cause = "client restarted too often, last " + clientcause;
+                break;
+            }
+        }
+        printf("Restarting client of X server %s in %lu ms, %s\n", display_id.c_str(),
+               (unsigned long)delay, clientcause.c_str());
+        clientpending = true;
+        clientdue = GetTickCount() + delay;
+    }
+
+    stats.End("Session");
+    CTrace::Instant("Child exited");
+    if (hungkill)
+        stats.SetOutcome(CLaunchStats::Hung);
+    else if (ret == WAIT_OBJECT_0 && hcount > 1)
+        stats.SetOutcome(CLaunchStats::ServerDied);
+
+    // Tell why we are done, by whichever process ended first, unless giving
+    // up on the client said so already
+    bool failed = !configrestart;
+    if (hungkill)
+        cause = "X server " + display_id + " was not responding";
+    else if (cause.empty())
+    {
+        if (ret == WAIT_OBJECT_0 + hcount)
+        {
+            cause = "stopped";
+            failed = false;
+        }
+        else if (ret < WAIT_OBJECT_0 + hcount)
+        {
+            DWORD code = 0;
+            GetExitCodeProcess(handles[ret - WAIT_OBJECT_0], &code);
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), " exited with status %lu", (unsigned long)code);
+            cause = (ret == WAIT_OBJECT_0 ? "X server " + display_id : std::string("client")) + buffer;
+            failed = code != 0;
+        }
+        else
+            cause = win32_error::message(GetLastError());
+    }
+
+    // Close our connection while the server is still there
+    if (monitor)
+    {
+        monitor->Stop();
+        if (debug)
+            monitor->Report();
+    }
+
+    // Stop what is still running, but only when we started a local
+    // program, were asked to or start again. The client goes first, so it
+    // doesn't lose its server.
+    if (config.local || Stopping() || configrestart)
+    {
+#ifdef _DEBUG
+    printf("killing process\n");
+#endif
+        CTraceScope trace("Shutdown");
+        DWORD grace = config.shutdown_timeout * 1000;
+        StopResult result;
+
+        if (pic.hProcess)
+        {
+            stats.Begin("Stop client");
+            result = StopProcess(pic.hProcess, pic.dwThreadId, StopBySignal, grace, clientgroup);
+            stats.End("Stop client");
+            if (debug)
+                ReportStop("Client", result);
+        }
+
+        if (!extraprocs.empty())
+        {
+            stats.Begin("Stop more clients");
+            StopMoreClients(extraprocs, extragroup, grace);
+            stats.End("Stop more clients");
+        }
+
+        stats.Begin("Stop server");
+        result = StopProcess(pi.hProcess, pi.dwThreadId, StopByWindowMessage, grace, &servergroup);
+        stats.End("Stop server");
+        if (debug)
+            ReportStop("X server", result);
+    }
+
+    DWORD server_code = 0, client_code = 0;
+    GetExitCodeProcess(pi.hProcess, &server_code);
+    if (pic.hProcess)
+        GetExitCodeProcess(pic.hProcess, &client_code);
+    stats.SetExitCodes(server_code, client_code);
+    if (!stats.Save() && debug)
+        printf("Can't save launch statistics: %s\n", strerror(errno));
+
+    if (metrics)
+    {
+        metrics->Sample(true);
+        delete metrics;
+    }
+
+    // Close process and thread handles.
+    CloseHandle( pi.hProcess );
+    CloseHandle( pi.hThread );
+    CloseHandle( pic.hProcess );
+    CloseHandle( pic.hThread );
+    delete clientgroup;
+    for (size_t i = 0; i < extraprocs.size(); i++)
+    {
+        CloseHandle(extraprocs[i].hProcess);
+        CloseHandle(extraprocs[i].hThread);
+    }
+
+    // A monitor thread still stuck on a hung server keeps using it
+    if (monitor && monitor->Wait(config.hung_timeout * 1000))
+        delete monitor;
+
+    return failed;
+}
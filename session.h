@@ -0,0 +1,121 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "config_schema.h"
+#include "lease.h"
+
+typedef struct _XDisplay Display;
+struct SpawnRequest;
+class CProcessGroup;
+class CFileWatch;
+
+/// @brief Print progress and diagnostics of sessions.
+extern bool debug;
+
+/// @brief An X server and its client, started from one configuration.
+/// Each session runs on its own thread, so a single xlaunch can supervise
+/// many displays. Everything a session changes for its children, like
+/// DISPLAY, is passed to them directly rather than set process wide.
+class CSession
+{
+    private:
+        CConfig config;
+        std::string name;        /// Identity of the configuration, for statistics.
+        std::string metricsfile; /// File to write resource usage to, if any.
+        CDisplayLease lease;     /// Keeps other launches off the display.
+        HANDLE thread;
+        HANDLE stop;             /// Signalled to end the session.
+        HANDLE replace;          /// Signalled to replace the client.
+        CRITICAL_SECTION lock;   /// Protects pendingprogram, and config while it is reloaded.
+        std::string pendingprogram;
+        std::string watchfile;   /// File to reload the configuration from, if any.
+        CConfig watched;         /// The configuration as last read from the file.
+        CFileWatch *watch;       /// Notices changes to watchfile, across restarts.
+        bool nodisplayfd;        /// The server only came up without -displayfd.
+        bool configrestart;      /// The server is restarting for a changed configuration.
+        bool failed;
+        static DWORD WINAPI ThreadProc(LPVOID param);
+        Display *OpenDisplay(std::string &display);
+        Display *WaitForServer(HANDLE serverProcess, HANDLE readyPipe, std::string &display);
+        void ClientCommand(const std::string &display, bool local, const std::string &program,
+                           std::vector<std::string> &argv, std::vector<std::string> &env, bool &show);
+        void StartServer(const std::vector<std::string> &args, bool displayfd, SpawnRequest &request,
+                         PROCESS_INFORMATION &pi, CProcessGroup &group, HANDLE &readyPipe);
+        void StartClient(SpawnRequest &request, PROCESS_INFORMATION &pic, CProcessGroup *&group);
+        void MoreClients(std::vector<CClientEntry> &extras);
+        void StartMoreClients(const std::string &display, const std::vector<CClientEntry> &extras,
+                              CProcessGroup &group, std::vector<PROCESS_INFORMATION> &procs);
+        void StopMoreClients(std::vector<PROCESS_INFORMATION> &procs, CProcessGroup &group, DWORD grace);
+        bool Reload(CConfigField::Scope &scope);
+        bool Launch(std::string &cause);
+    public:
+        /// A display of "auto" is replaced by the lowest free display number.
+        /// @param config Configuration to run. The session keeps a copy.
+        /// @param name Identity of the configuration, eg. the path of its file.
+        /// @param metricsfile File to write resource usage to, or empty.
+        /// @param perdisplay Name the metrics file after the display, see SessionMetricsFile().
+        /// @throws std::runtime_error if no display could be allocated.
+        CSession(const CConfig &config, const std::string &name, const std::string &metricsfile,
+                 bool perdisplay = false);
+        ~CSession();
+        /// @brief Apply changes to the file of the configuration while running.
+        /// Changes to the client are applied by starting it and the other
+        /// clients again, changes to the server by restarting the session.
+        /// Call before Run() or Start().
+        void Watch(const std::string &filename) { watchfile = filename; }
+        /// @brief Start the server and client, and start them again when
+        /// they end as the restart policy of the configuration says.
+        /// @throws std::runtime_error if the session can't be started, or
+        /// was restarted too often.
+        void Run();
+        /// @brief Run() the session on a new thread.
+        void Start();
+        /// @brief Wait until a session started with Start() has ended.
+        /// @return false if the session failed.
+        bool Join();
+        /// @brief Ask the session to stop its server and client and end.
+        void Stop();
+        bool Stopping();
+        /// @brief Stop the client and start it again, keeping the server.
+        /// @param program Program to run instead, or empty for the same one.
+        /// @return false if the configuration doesn't keep the server.
+        bool ReplaceClient(const std::string &program);
+        /// @brief Check if the thread of the session has ended.
+        bool Finished();
+        bool Failed() { return failed; }
+        const CConfig &Config() { return config; }
+        const std::string &Name() { return name; }
+};
+
+/// @brief Name of the metrics file of one of several sessions.
+/// The display number is added before the extension, eg. xlaunch-1.prom
+std::string SessionMetricsFile(const std::string &filename, const std::string &display);
+
+#endif
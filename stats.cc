@@ -0,0 +1,348 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <map>
+#include <stdexcept>
+#include "stats.h"
+#include "trace.h"
+
+/*
+ * Each line of the statistics file holds one counter set:
+ *   <config> TAB <kind> TAB <name> TAB <key>:<count> ...
+ * For "phase" lines the keys are histogram buckets of the duration, for
+ * "outcome" and "exit" lines they are the outcome names and exit codes.
+ * Percent signs, tabs and line breaks in the config are escaped as %XX,
+ * so any path fits on its line.
+ */
+typedef std::map<std::string, unsigned long> Counters;
+typedef std::map<std::string, Counters> CounterSets;
+
+#define STATS_FILE ".xlaunch_stats"
+
+/* Histogram buckets grow by 2^(1/BUCKET_STEPS), ie. about 9% per bucket */
+#define BUCKET_STEPS 8
+#define BUCKET_MAX 255
+
+static const char *outcome_names[] = { "ok", "server-died", "timeout", "client-failed", "hung" };
+
+static int Bucket(double ms)
+{
+    if (ms < 1.0)
+        return 0;
+    int bucket = 1 + (int)floor(BUCKET_STEPS * log2(ms));
+    return bucket > BUCKET_MAX ? BUCKET_MAX : bucket;
+}
+
+/// @brief Representative duration of a bucket, in ms.
+static double BucketValue(int bucket)
+{
+    if (bucket == 0)
+        return 0.5;
+    return exp2((bucket - 0.5) / BUCKET_STEPS);
+}
+
+/// @brief Escape a config path for the statistics file.
+static std::string Escape(const std::string &str)
+{
+    std::string out;
+    for (size_t i = 0; i < str.size(); i++)
+    {
+        if (str[i] == '%' || str[i] == '\t' || str[i] == '\n' || str[i] == '\r')
+        {
+            char hex[4];
+            snprintf(hex, sizeof(hex), "%%%02X", (unsigned char)str[i]);
+            out += hex;
+        }
+        else
+            out += str[i];
+    }
+    return out;
+}
+
+/// @brief Undo Escape().
+static std::string Unescape(const std::string &str)
+{
+    std::string out;
+    for (size_t i = 0; i < str.size(); i++)
+    {
+        if (str[i] == '%' && i + 2 < str.size() && isxdigit((unsigned char)str[i + 1]) &&
+            isxdigit((unsigned char)str[i + 2]))
+        {
+            out += (char)strtol(str.substr(i + 1, 2).c_str(), NULL, 16);
+            i += 2;
+        }
+        else
+            out += str[i];
+    }
+    return out;
+}
+
+static std::string StatsPath()
+{
+    const char *home = getenv("HOME");
+    if (home == NULL || *home == 0)
+        return "";
+    return std::string(home) + "/" STATS_FILE;
+}
+
+/// @return false if the file exists but couldn't be read.
+static bool Read(const std::string &path, CounterSets &sets)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == NULL)
+        return errno == ENOENT;
+    // Lines can be of any length, as config names are
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, f)) >= 0)
+    {
+        std::string str(line, len);
+        size_t tab = str.rfind('\t');
+        if (tab == std::string::npos)
+            continue;
+        Counters &counters = sets[str.substr(0, tab)];
+        const char *p = str.c_str() + tab + 1;
+        while (*p && *p != '\n')
+        {
+            const char *colon = strchr(p, ':');
+            if (colon == NULL)
+                break;
+            char *end;
+            unsigned long count = strtoul(colon + 1, &end, 10);
+            counters[std::string(p, colon - p)] += count;
+            p = end;
+            while (*p == ' ')
+                p++;
+        }
+    }
+    free(line);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static bool Write(const std::string &path, const CounterSets &sets)
+{
+    std::string temp = path + ".tmp";
+    FILE *f = fopen(temp.c_str(), "w");
+    if (f == NULL)
+        return false;
+    for (CounterSets::const_iterator i = sets.begin(); i != sets.end(); ++i)
+    {
+        fprintf(f, "%s\t", i->first.c_str());
+        for (Counters::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
+            fprintf(f, "%s%s:%lu", j == i->second.begin() ? "" : " ", j->first.c_str(), j->second);
+        fprintf(f, "\n");
+    }
+    bool ok = !ferror(f);
+    if (fclose(f) != 0 || !ok || rename(temp.c_str(), path.c_str()) != 0)
+    {
+        int error = errno;
+        remove(temp.c_str());
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+CLaunchStats::CLaunchStats(const std::string &config) :
+    config(config), outcome(Ok), have_codes(false), server_code(0), client_code(0),
+    saved(false)
+{
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&started);
+    phase_started = started;
+}
+
+CLaunchStats::~CLaunchStats()
+{
+    Save();
+}
+
+double CLaunchStats::Elapsed(const LARGE_INTEGER &since)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (now.QuadPart - since.QuadPart) * 1000.0 / frequency.QuadPart;
+}
+
+void CLaunchStats::Begin(const char *name)
+{
+    CTrace::Begin(name);
+    QueryPerformanceCounter(&phase_started);
+}
+
+void CLaunchStats::End(const char *name)
+{
+    phases.push_back(std::make_pair(std::string(name), Elapsed(phase_started)));
+    CTrace::End(name);
+}
+
+void CLaunchStats::SetExitCodes(DWORD server, DWORD client)
+{
+    have_codes = true;
+    server_code = server;
+    client_code = client;
+}
+
+bool CLaunchStats::Save()
+{
+    if (saved)
+        return true;
+    saved = true;
+
+    std::string path = StatsPath();
+    if (path.empty())
+        return true;
+
+    CounterSets record;
+    std::string prefix = Escape(config) + "\t";
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+        char key[8];
+        snprintf(key, sizeof(key), "%d", Bucket(phases[i].second));
+        record[prefix + "phase\t" + phases[i].first][key]++;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "%d", Bucket(Elapsed(started)));
+    record[prefix + "phase\tTotal"][key]++;
+    record[prefix + "outcome\toutcome"][outcome_names[outcome]]++;
+    if (have_codes)
+    {
+        char code[16];
+        snprintf(code, sizeof(code), "%lu", (unsigned long)server_code);
+        record[prefix + "exit\tserver"][code]++;
+        snprintf(code, sizeof(code), "%lu", (unsigned long)client_code);
+        record[prefix + "exit\tclient"][code]++;
+    }
+
+    // Serialize concurrent launches updating the file
+    std::string lockpath = path + ".lock";
+    int lock = open(lockpath.c_str(), O_RDWR | O_CREAT, 0600);
+    if (lock < 0)
+        return false;
+    bool ok = flock(lock, LOCK_EX) == 0;
+    if (ok)
+    {
+        // Rather lose this record than the counts the file already holds
+        CounterSets sets;
+        ok = Read(path, sets);
+        for (CounterSets::iterator i = record.begin(); ok && i != record.end(); ++i)
+            for (Counters::iterator j = i->second.begin(); j != i->second.end(); ++j)
+                sets[i->first][j->first] += j->second;
+        ok = ok && Write(path, sets);
+    }
+    int error = errno;
+    close(lock);
+    errno = error;
+    return ok;
+}
+
+/// @brief Duration below which the given fraction of the samples lie.
+static double Percentile(const Counters &counters, unsigned long total, double fraction)
+{
+    std::map<int, unsigned long> buckets;
+    for (Counters::const_iterator i = counters.begin(); i != counters.end(); ++i)
+        buckets[atoi(i->first.c_str())] += i->second;
+
+    unsigned long rank = (unsigned long)ceil(fraction * total);
+    unsigned long seen = 0;
+    for (std::map<int, unsigned long>::iterator i = buckets.begin(); i != buckets.end(); ++i)
+    {
+        seen += i->second;
+        if (seen >= rank)
+            return BucketValue(i->first);
+    }
+    return BucketValue(buckets.rbegin()->first);
+}
+
+void CLaunchStats::Print()
+{
+    std::string path = StatsPath();
+    CounterSets sets;
+    if (!path.empty() && !Read(path, sets))
+        throw std::runtime_error("Can't read " + path + ": " + strerror(errno));
+    if (sets.empty())
+    {
+        printf("No launch statistics recorded\n");
+        return;
+    }
+
+    // Collect the phase table and the other counters of each config
+    std::map<std::string, std::pair<std::string, std::string> > report;
+    for (CounterSets::iterator i = sets.begin(); i != sets.end(); ++i)
+    {
+        size_t tab1 = i->first.find('\t');
+        size_t tab2 = i->first.find('\t', tab1 + 1);
+        if (tab1 == std::string::npos || tab2 == std::string::npos)
+            continue;
+        std::string config = Unescape(i->first.substr(0, tab1));
+        std::string kind = i->first.substr(tab1 + 1, tab2 - tab1 - 1);
+        std::string name = i->first.substr(tab2 + 1);
+
+        unsigned long total = 0;
+        for (Counters::iterator j = i->second.begin(); j != i->second.end(); ++j)
+            total += j->second;
+
+        char line[256];
+        if (kind == "phase")
+        {
+            snprintf(line, sizeof(line), "  %-24s %8lu %10.1f %10.1f %10.1f\n",
+                     name.c_str(), total,
+                     Percentile(i->second, total, 0.50),
+                     Percentile(i->second, total, 0.90),
+                     Percentile(i->second, total, 0.99));
+            report[config].first += line;
+        }
+        else
+        {
+            std::string &text = report[config].second;
+            text += "  " + (kind == name ? kind : kind + " " + name) + ":";
+            for (Counters::iterator j = i->second.begin(); j != i->second.end(); ++j)
+            {
+                snprintf(line, sizeof(line), " %s=%lu", j->first.c_str(), j->second);
+                text += line;
+            }
+            text += "\n";
+        }
+    }
+
+    for (std::map<std::string, std::pair<std::string, std::string> >::iterator i = report.begin();
+         i != report.end(); ++i)
+    {
+        printf("%s\n", i->first.c_str());
+        printf("  %-24s %8s %10s %10s %10s\n", "phase (ms)", "count", "p50", "p90", "p99");
+        printf("%s%s", i->second.first.c_str(), i->second.second.c_str());
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+/// @brief Timings and outcome of a single launch.
+/// The record is merged into a per-user statistics file, which keeps a
+/// histogram of each phase duration per configuration, so it does not grow
+/// with the number of launches.
+class CLaunchStats
+{
+    public:
+        enum Outcome { Ok, ServerDied, Timeout, ClientFailed, Hung };
+    private:
+        std::string config;
+        std::vector<std::pair<std::string, double> > phases;
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER started;
+        LARGE_INTEGER phase_started;
+        Outcome outcome;
+        bool have_codes;
+        DWORD server_code;
+        DWORD client_code;
+        bool saved;
+        double Elapsed(const LARGE_INTEGER &since);
+    public:
+        /// @param config Identity of the configuration being launched.
+        CLaunchStats(const std::string &config);
+        /// @brief Save the record, if not done already.
+        ~CLaunchStats();
+        /// @brief Start timing a phase. Also records it in the trace.
+        void Begin(const char *name);
+        /// @brief Record the duration of the phase started last.
+        void End(const char *name);
+        void SetOutcome(Outcome outcome) { this->outcome = outcome; }
+        void SetExitCodes(DWORD server, DWORD client);
+        /// @brief Merge the record into the statistics file.
+        /// @return false, with errno set, if the file couldn't be updated.
+        bool Save();
+        /// @brief Print percentiles per configuration and phase.
+        static void Print();
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+/// @brief Monotonic time in microseconds.
+static inline double BenchNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/// @brief Number of iterations: the first argument if given, else a default.
+static inline int BenchIterations(int argc, char **argv, int def)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 0;
+    return n > 0 ? n : def;
+}
+
+/// @brief Print the column headings of BenchReport().
+static inline void BenchHeader(const char *unit)
+{
+    printf("%-36s %8s %10s %10s %10s\n", "", "count", "mean", "p50", "p99");
+    printf("%-36s %8s %10s %10s %10s\n", "", "", unit, unit, unit);
+}
+
+/// @brief Print the mean, median and 99th percentile of samples.
+static inline void BenchReport(const char *name, std::vector<double> samples)
+{
+    if (samples.empty())
+        return;
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (size_t i = 0; i < samples.size(); i++)
+        sum += samples[i];
+    size_t p99 = (samples.size() * 99 + 99) / 100 - 1;
+    printf("%-36s %8lu %10.1f %10.1f %10.1f\n", name, (unsigned long)samples.size(),
+           sum / samples.size(), samples[samples.size() / 2], samples[p99]);
+}
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/*
+ * Configurations loaded and saved by many threads at once.
+ *
+ * Each thread saves and loads a file of its own, while all of them load a
+ * shared file which one of them keeps replacing. Loads must always see
+ * one whole version of a file. Last, a process exits while its threads
+ * are still loading, which must not crash the parser's exit handler.
+ *
+ *   tests/config_stress [iterations]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include "config.h"
+#include "bench.h"
+
+#define THREADS 16
+#define EXITS 20
+
+static int failures = 0;
+static char dir[] = "/tmp/xlaunch-stress-XXXXXX";
+static std::string shared;
+static int iterations;
+static volatile long mismatches, torn;
+
+static void Check(bool ok, const char *what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+/// @brief A configuration which tells where it came from.
+static CConfig Version(int thread, int n)
+{
+    char host[64], program[64];
+    snprintf(host, sizeof(host), "host%d-%d.example.org", thread, n);
+    snprintf(program, sizeof(program), "xterm -T \"%d & %d\"", thread, n);
+    CConfig config;
+    config.client = CConfig::StartProgram;
+    config.host = host;
+    config.protocol = "ssh";
+    config.remoteprogram = program;
+    config.restart_limit = n;
+    config.clients.push_back(CClientEntry(true, program));
+    return config;
+}
+
+static bool Same(const CConfig &a, const CConfig &b)
+{
+    return a.host == b.host && a.remoteprogram == b.remoteprogram &&
+        a.restart_limit == b.restart_limit && a.clients.size() == b.clients.size() &&
+        (a.clients.empty() || a.clients[0].program == b.clients[0].program);
+}
+
+static void *Worker(void *arg)
+{
+    int thread = (int)(long)arg;
+    char name[64];
+    snprintf(name, sizeof(name), "%s/thread%d.xlaunch", dir, thread);
+
+    for (int n = 0; n < iterations; n++)
+    {
+        CConfig saved = Version(thread, n), loaded;
+        try {
+            saved.Save(name);
+            // The first thread keeps replacing the shared file too
+            if (thread == 0)
+                Version(THREADS, n).Save(shared.c_str());
+        } catch (std::runtime_error &e)
+        {
+            fprintf(stderr, "%s\n", e.what());
+            __sync_fetch_and_add(&mismatches, 1);
+            continue;
+        }
+        if (!loaded.Load(name) || !Same(saved, loaded))
+            __sync_fetch_and_add(&mismatches, 1);
+
+        // Whichever version it is, it must be whole
+        CConfig other;
+        if (!other.Load(shared.c_str()) ||
+            !Same(other, Version(THREADS, other.restart_limit)))
+            __sync_fetch_and_add(&torn, 1);
+    }
+    return NULL;
+}
+
+static void *Loader(void *arg)
+{
+    for (;;)
+    {
+        CConfig config;
+        config.Load(shared.c_str());
+    }
+    return NULL;
+}
+
+/// @brief Exit a process while its threads are busy in the parser.
+/// @return true if it exited normally.
+static bool ExitWhileLoading()
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // An exit handler waiting for the loaders for good fails too
+        alarm(10);
+        pthread_t threads[THREADS];
+        for (int i = 0; i < THREADS; i++)
+            pthread_create(&threads[i], NULL, Loader, NULL);
+        usleep(20000);
+        exit(0);
+    }
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+        WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    iterations = BenchIterations(argc, argv, 200);
+    if (mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp");
+        return 2;
+    }
+    shared = std::string(dir) + "/shared.xlaunch";
+    Version(THREADS, 0).Save(shared.c_str());
+
+    double start = BenchNow();
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, Worker, (void *)(long)i);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    printf("%d threads saved and loaded %d configurations each in %.0f ms\n",
+           THREADS, iterations * 2, (BenchNow() - start) / 1000);
+    Check(mismatches == 0, "each thread loads what it saved");
+    Check(torn == 0, "loads of a file being replaced see a whole version");
+
+    int exited = 0;
+    for (int i = 0; i < EXITS; i++)
+        if (ExitWhileLoading())
+            exited++;
+    Check(exited == EXITS, "exiting while threads load is clean");
+
+    std::string command = std::string("rm -rf ") + dir;
+    if (system(command.c_str()) != 0)
+        fprintf(stderr, "Can't remove %s\n", dir);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/*
+ * Latency of loading a configuration file through LoadCompiledConfig,
+ * compared with parsing the XML with CConfig::Load. "compile" is the first
+ * load of each file, which parses it and writes the compiled copy, "cached"
+ * the loads after that. The compiled copies go to a temporary directory.
+ *
+ *   tests/configcache_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include "config.h"
+#include "configcache.h"
+#include "bench.h"
+
+#define FILES 100
+
+int main(int argc, char **argv)
+{
+    int iterations = BenchIterations(argc, argv, 20);
+
+    char dir[] = "/tmp/xlaunch-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    setenv("XDG_CACHE_HOME", dir, 1);
+
+    std::vector<std::string> files;
+    std::vector<double> xml, compile, cached;
+    try {
+        for (int i = 0; i < FILES; i++)
+        {
+            char name[64], value[32];
+            snprintf(name, sizeof(name), "%s/config%d.xlaunch", dir, i);
+            snprintf(value, sizeof(value), "host%d.example.org", i);
+            CConfig config;
+            config.client = CConfig::StartProgram;
+            config.host = value;
+            config.protocol = "ssh";
+            config.restart_limit = i;
+            for (int c = 0; c < 4; c++)
+                config.clients.push_back(CClientEntry(c % 2, value));
+            config.Save(name);
+            files.push_back(name);
+        }
+
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            CConfig config;
+            double start = BenchNow();
+            if (!LoadCompiledConfig(files[i].c_str(), config))
+                throw std::runtime_error("Can't load " + files[i]);
+            compile.push_back(BenchNow() - start);
+        }
+
+        for (int n = 0; n < iterations; n++)
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                CConfig config;
+                double start = BenchNow();
+                if (!config.Load(files[i].c_str()))
+                    throw std::runtime_error("Can't parse " + files[i]);
+                xml.push_back(BenchNow() - start);
+
+                CConfig compiled;
+                start = BenchNow();
+                if (!LoadCompiledConfig(files[i].c_str(), compiled))
+                    throw std::runtime_error("Can't load " + files[i]);
+                cached.push_back(BenchNow() - start);
+            }
+    } catch (std::runtime_error &e)
+    {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    std::string command = std::string("rm -rf ") + dir;
+    if (system(command.c_str()) != 0)
+        fprintf(stderr, "Can't remove %s\n", dir);
+
+    BenchHeader("us");
+    BenchReport("XML load", xml);
+    BenchReport("Compiled load, compile", compile);
+    BenchReport("Compiled load, cached", cached);
+    return 0;
+}
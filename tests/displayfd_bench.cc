@@ -0,0 +1,200 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/*
+ * Time until an X server is known to be ready, when it reports readiness
+ * on -displayfd, when it is polled with ProbeDisplay as WaitForServer does
+ * without -displayfd, and when it rejects -displayfd so that it is started
+ * again and polled. The server is a stand-in which takes a few ms to start
+ * and then answers connection setup requests on TCP.
+ *
+ *   tests/displayfd_bench [iterations]
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdexcept>
+#include "probe.h"
+#include "bench.h"
+
+#define DISPLAY 173
+#define STARTUP_MIN 5000    /* us */
+#define STARTUP_MAX 25000   /* us */
+
+enum Mode { DisplayFd, Polling, Rejecting };
+
+/// @brief Stand-in for an X server, run in a child process.
+/// @param readyfd Pipe to write the display number to when ready, or -1.
+static void Serve(int readyfd, unsigned startup)
+{
+    usleep(startup);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(6000 + DISPLAY);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0)
+        _exit(1);
+
+    if (readyfd >= 0)
+    {
+        char number[16];
+        int length = snprintf(number, sizeof(number), "%d\n", DISPLAY);
+        if (write(readyfd, number, length) != length)
+            _exit(1);
+        close(readyfd);
+    }
+
+    for (;;)
+    {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0)
+            continue;
+        // Read the setup request and answer it with Failed, which is enough for a probe
+        char request[12];
+        if (read(client, request, sizeof(request)) > 0)
+        {
+            unsigned char status = 0;
+            if (write(client, &status, 1) != 1)
+                _exit(1);
+        }
+        close(client);
+    }
+}
+
+/// @brief Start the stand-in server.
+/// @param readyfd Receives the read end of the -displayfd pipe, or -1.
+/// @param reject Exit at once when given -displayfd, like a server which
+/// doesn't know the option.
+static pid_t Start(bool displayfd, bool reject, unsigned startup, int &readyfd)
+{
+    int fds[2] = { -1, -1 };
+    if (displayfd && pipe(fds) != 0)
+        throw std::runtime_error("pipe failed");
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (displayfd)
+        {
+            close(fds[0]);
+            if (reject)
+                _exit(1);
+        }
+        Serve(fds[1], startup);
+    }
+    if (pid < 0)
+        throw std::runtime_error("fork failed");
+    if (displayfd)
+        close(fds[1]);
+    readyfd = fds[0];
+    return pid;
+}
+
+/// @brief Probe with the increasing delay of WaitForServer.
+static bool Poll(pid_t pid)
+{
+    unsigned delay = PROBE_MIN_DELAY;
+    for (int tries = 0; tries < 1000; tries++)
+    {
+        if (ProbeDisplay(DISPLAY))
+            return true;
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            return false;
+        usleep(delay * 1000);
+        delay = delay * 2 < PROBE_MAX_DELAY ? delay * 2 : PROBE_MAX_DELAY;
+    }
+    return false;
+}
+
+/// @brief Start a server and wait until it is ready.
+/// @return Time taken, in us.
+static double Launch(Mode mode, unsigned startup)
+{
+    double start = BenchNow();
+    int readyfd;
+    pid_t pid = Start(mode != Polling, mode == Rejecting, startup, readyfd);
+    bool ready = false;
+    if (readyfd >= 0)
+    {
+        char c;
+        // Readiness is followed by a connection, as XOpenDisplay would make
+        ready = read(readyfd, &c, 1) == 1 && ProbeDisplay(DISPLAY);
+        close(readyfd);
+        if (!ready)
+        {
+            // Exited without reporting, start it again without -displayfd
+            waitpid(pid, NULL, 0);
+            pid = Start(false, false, startup, readyfd);
+        }
+    }
+    if (!ready)
+        ready = Poll(pid);
+    double took = BenchNow() - start;
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    if (!ready)
+        throw std::runtime_error("stand-in server didn't come up");
+    return took;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = BenchIterations(argc, argv, 200);
+
+    std::vector<double> samples[3];
+    srand(1);
+    try {
+        for (int i = 0; i < iterations; i++)
+        {
+            // The same startup times for each way
+            unsigned startup = STARTUP_MIN + rand() % (STARTUP_MAX - STARTUP_MIN);
+            samples[DisplayFd].push_back(Launch(DisplayFd, startup));
+            samples[Polling].push_back(Launch(Polling, startup));
+            samples[Rejecting].push_back(Launch(Rejecting, startup));
+        }
+    } catch (std::runtime_error &e)
+    {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    BenchHeader("us");
+    BenchReport("-displayfd", samples[DisplayFd]);
+    BenchReport("Polling", samples[Polling]);
+    BenchReport("-displayfd rejected, polling", samples[Rejecting]);
+    return 0;
+}
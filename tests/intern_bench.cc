@@ -0,0 +1,227 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/*
+ * Memory held by many loaded configurations, with the interned strings of
+ * CConfig compared with a copy of each string per configuration, as
+ * CConfig held them before. Each way runs in a process of its own, which
+ * reports how much its resident size grew for the configurations, and how
+ * long copying all of them takes.
+ *
+ *   tests/intern_bench [configurations]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include "config.h"
+#include "bench.h"
+
+#define FILES 100
+
+/// @brief A client entry as it was before interning.
+struct PlainClient
+{
+    bool local;
+    std::string program;
+};
+
+/// @brief The members of CConfig as they were before interning.
+struct PlainConfig
+{
+    int window, client, restart;
+    bool local;
+    std::string display, protocol, localprogram, remoteprogram, host, user;
+    bool broadcast, indirect;
+    std::string xdmcp_host;
+    bool clipboard, wgl, disableac, xdmcpterminate;
+    std::string extra_params;
+    bool keychain, terminal;
+    std::string extra_ssh;
+    unsigned server_timeout, monitor_interval, hung_timeout, restart_delay,
+        restart_max_delay, restart_limit, restart_window;
+    bool keep_server;
+    std::vector<PlainClient> clients;
+    bool autostart;
+    unsigned shutdown_timeout;
+    bool cache_login_env;
+
+    PlainConfig(const CConfig &c) :
+        window(c.window), client(c.client), restart(c.restart), local(c.local),
+        display(c.display.c_str()), protocol(c.protocol.c_str()),
+        localprogram(c.localprogram.c_str()), remoteprogram(c.remoteprogram.c_str()),
+        host(c.host.c_str()), user(c.user.c_str()), broadcast(c.broadcast),
+        indirect(c.indirect), xdmcp_host(c.xdmcp_host.c_str()), clipboard(c.clipboard),
+        wgl(c.wgl), disableac(c.disableac), xdmcpterminate(c.xdmcpterminate),
+        extra_params(c.extra_params.c_str()), keychain(c.keychain), terminal(c.terminal),
+        extra_ssh(c.extra_ssh.c_str()), server_timeout(c.server_timeout),
+        monitor_interval(c.monitor_interval), hung_timeout(c.hung_timeout),
+        restart_delay(c.restart_delay), restart_max_delay(c.restart_max_delay),
+        restart_limit(c.restart_limit), restart_window(c.restart_window),
+        keep_server(c.keep_server), autostart(c.autostart),
+        shutdown_timeout(c.shutdown_timeout), cache_login_env(c.cache_login_env)
+    {
+        for (size_t i = 0; i < c.clients.size(); i++)
+        {
+            PlainClient entry;
+            entry.local = c.clients[i].local;
+            entry.program = c.clients[i].program.c_str();
+            clients.push_back(entry);
+        }
+    }
+};
+
+/// @brief Resident size of this process, in bytes.
+static long Resident()
+{
+    long size, resident;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL)
+        return 0;
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+        resident = 0;
+    fclose(f);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+struct Result
+{
+    double bytes;   /// Growth of the resident size per configuration.
+    double copy;    /// Time to copy all configurations, in us.
+};
+
+/// @brief Load count configurations from the files and keep them.
+template <class T>
+static Result Measure(const std::vector<std::string> &files, int count)
+{
+    std::vector<T> configs;
+    configs.reserve(count);
+    // Don't count setting up the parser
+    CConfig().Load(files[0].c_str());
+    long before = Resident();
+    for (int i = 0; i < count; i++)
+    {
+        CConfig config;
+        if (!config.Load(files[i % files.size()].c_str()))
+            throw std::runtime_error("Can't load " + files[i % files.size()]);
+        configs.push_back(T(config));
+    }
+    Result result;
+    result.bytes = (double)(Resident() - before) / count;
+    double start = BenchNow();
+    std::vector<T> copy(configs);
+    result.copy = BenchNow() - start;
+    return result;
+}
+
+/// @brief Run a measurement in a process of its own, so neither way
+/// reuses memory the other freed.
+template <class T>
+static Result Child(const std::vector<std::string> &files, int count)
+{
+    int fds[2];
+    Result result = { 0, 0 };
+    if (pipe(fds) != 0)
+        throw std::runtime_error("pipe failed");
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        try {
+            result = Measure<T>(files, count);
+        } catch (std::runtime_error &e)
+        {
+            fprintf(stderr, "Error: %s\n", e.what());
+            _exit(1);
+        }
+        _exit(write(fds[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = pid > 0 && read(fds[0], &result, sizeof(result)) == sizeof(result);
+    close(fds[0]);
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+    if (!ok)
+        throw std::runtime_error("measurement failed");
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int count = BenchIterations(argc, argv, 10000);
+
+    char dir[] = "/tmp/xlaunch-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    // Many configurations share their hosts, programs and options
+    std::vector<std::string> files;
+    Result interned, plain;
+    try {
+        for (int i = 0; i < FILES; i++)
+        {
+            char name[64], host[64];
+            snprintf(name, sizeof(name), "%s/config%d.xlaunch", dir, i);
+            snprintf(host, sizeof(host), "build-host-%02d.example.org", i % 20);
+            CConfig config;
+            config.client = CConfig::StartProgram;
+            config.local = false;
+            config.host = host;
+            config.user = "developer";
+            config.protocol = "ssh";
+            config.remoteprogram = i % 2 ? "xterm -ls -geometry 120x40" : "gnome-terminal --maximize";
+            config.extra_params = "-dpi 96 -listen tcp";
+            config.extra_ssh = "-o ServerAliveInterval=30";
+            config.clients.push_back(CClientEntry(true, "xclock -geometry 100x100-0+0"));
+            config.Save(name);
+            files.push_back(name);
+        }
+
+        interned = Child<CConfig>(files, count);
+        plain = Child<PlainConfig>(files, count);
+    } catch (std::runtime_error &e)
+    {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    std::string command = std::string("rm -rf ") + dir;
+    if (system(command.c_str()) != 0)
+        fprintf(stderr, "Can't remove %s\n", dir);
+
+    printf("%-36s %16s %16s %14s\n", "", "bytes/config", "KiB/10k configs", "copy all, us");
+    printf("%-36s %16.0f %16.0f %14.0f\n", "Interned strings", interned.bytes,
+           interned.bytes * 10000 / 1024, interned.copy);
+    printf("%-36s %16.0f %16.0f %14.0f\n", "A copy of each string", plain.bytes,
+           plain.bytes * 10000 / 1024, plain.copy);
+    return 0;
+}
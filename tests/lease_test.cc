@@ -0,0 +1,203 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/*
+ * Display leases taken by concurrent launchers.
+ *
+ * Many processes reserve a display at the same moment and must all get
+ * different numbers. Leases of processes which are gone, and lock files of
+ * dead servers, must be taken over. The numbers used are far above those
+ * of real servers.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <set>
+#include "lease.h"
+#include "bench.h"
+
+#define LAUNCHERS 64
+#define HELD 300
+
+static int failures = 0;
+
+static void Check(bool ok, const char *what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+/// @brief Start launchers which all reserve a display once released.
+/// @return The numbers they got.
+static std::set<unsigned> ParallelLaunchers(unsigned base, std::vector<unsigned> &numbers)
+{
+    int go[2], results[2], done[2];
+    if (pipe(go) != 0 || pipe(results) != 0 || pipe(done) != 0)
+        exit(2);
+    std::vector<pid_t> children;
+    for (int i = 0; i < LAUNCHERS; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(go[1]);
+            close(done[1]);
+            char c;
+            read(go[0], &c, 1);
+            CDisplayLease lease;
+            unsigned number = lease.Acquire(base);
+            write(results[1], &number, sizeof(number));
+            // Keep the lease until all have one
+            read(done[0], &c, 1);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    close(go[0]);
+    close(go[1]);
+    close(results[1]);
+    unsigned number;
+    while (read(results[0], &number, sizeof(number)) == sizeof(number))
+    {
+        numbers.push_back(number);
+        if (numbers.size() == LAUNCHERS)
+            break;
+    }
+    close(done[1]);
+    for (size_t i = 0; i < children.size(); i++)
+        waitpid(children[i], NULL, 0);
+    close(results[0]);
+    close(done[0]);
+    return std::set<unsigned>(numbers.begin(), numbers.end());
+}
+
+/// @brief A pid of no process.
+static pid_t DeadPid()
+{
+    pid_t pid = fork();
+    if (pid == 0)
+        _exit(0);
+    waitpid(pid, NULL, 0);
+    return pid;
+}
+
+static void WriteLock(unsigned display, pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/.X%u-lock", display);
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        exit(2);
+    fprintf(f, "%10d\n", (int)pid);
+    fclose(f);
+}
+
+static bool LockExists(unsigned display)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/.X%u-lock", display);
+    return access(path, F_OK) == 0;
+}
+
+static void RemoveLock(unsigned display)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/.X%u-lock", display);
+    unlink(path);
+}
+
+int main()
+{
+    unsigned base = 10000 + (getpid() % 1000) * 1000;
+
+    std::vector<unsigned> numbers;
+    std::set<unsigned> unique = ParallelLaunchers(base, numbers);
+    Check(numbers.size() == LAUNCHERS, "every launcher got a display");
+    Check(unique.size() == numbers.size(), "no two launchers got the same display");
+    Check(!unique.empty() && *unique.begin() == base && *unique.rbegin() == base + LAUNCHERS - 1,
+          "the lowest free displays were given out");
+
+    // Launchers which exited without giving their lease back
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        CDisplayLease *lease = new CDisplayLease;
+        lease->Acquire(base);
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+    {
+        CDisplayLease lease;
+        Check(lease.Acquire(base) == base, "the lease of a launcher which is gone is taken over");
+        CDisplayLease second;
+        Check(second.Acquire(base) == base + 1, "a held lease is skipped");
+    }
+
+    {
+        CDisplayLease chosen;
+        chosen.Reserve(base);
+        CDisplayLease lease;
+        Check(lease.Acquire(base) == base + 1, "a display reserved by the user is skipped");
+    }
+
+    WriteLock(base, DeadPid());
+    WriteLock(base + 1, getpid());
+    {
+        CDisplayLease lease;
+        Check(lease.Acquire(base) == base && !LockExists(base),
+              "the lock file of a dead server is removed and its display used");
+        CDisplayLease second;
+        Check(second.Acquire(base) == base + 2, "the display of a live server is skipped");
+    }
+    RemoveLock(base);
+    RemoveLock(base + 1);
+
+    // Cost of a reservation with many displays in use
+    std::vector<CDisplayLease *> held;
+    for (int i = 0; i < HELD; i++)
+    {
+        held.push_back(new CDisplayLease);
+        held.back()->Acquire(base);
+    }
+    std::vector<double> samples;
+    for (int i = 0; i < 20; i++)
+    {
+        CDisplayLease lease;
+        double start = BenchNow();
+        lease.Acquire(base);
+        samples.push_back(BenchNow() - start);
+    }
+    for (size_t i = 0; i < held.size(); i++)
+        delete held[i];
+    BenchHeader("us");
+    BenchReport("Acquire with 300 displays held", samples);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/*
+ * Latency of loading a configuration file with the streaming reader of
+ * CConfig::Load, compared with building a DOM with xmlReadFile and looking
+ * up each attribute with xmlGetProp, as the loader did before. Both read
+ * the same corpus of files, which differ in their hosts and programs.
+ *
+ *   tests/parse_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <stdexcept>
+#include <string>
+#include "config.h"
+#include "config_schema.h"
+#include "bench.h"
+
+#define FILES 200
+
+/// @brief Load a file through a DOM.
+static bool LoadDom(const char *filename, CConfig &config)
+{
+    xmlDocPtr doc = xmlReadFile(filename, NULL, 0);
+    if (doc == NULL)
+        return false;
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+    if (root == NULL || !xmlStrEqual(root->name, BAD_CAST "XLaunch"))
+    {
+        xmlFreeDoc(doc);
+        return false;
+    }
+    for (size_t i = 0; i < config_field_count; i++)
+    {
+        xmlChar *value = xmlGetProp(root, BAD_CAST config_fields[i].name);
+        if (value)
+        {
+            SetConfigField(config, config_fields[i], (const char *)value);
+            xmlFree(value);
+        }
+    }
+    config.clients.clear();
+    for (xmlNodePtr node = root->children; node; node = node->next)
+    {
+        if (node->type != XML_ELEMENT_NODE || !xmlStrEqual(node->name, BAD_CAST "Client"))
+            continue;
+        xmlChar *local = xmlGetProp(node, BAD_CAST "Local");
+        xmlChar *program = xmlGetProp(node, BAD_CAST "Program");
+        config.clients.push_back(CClientEntry(local && xmlStrEqual(local, BAD_CAST "True"),
+                                              program ? (const char *)program : ""));
+        xmlFree(local);
+        xmlFree(program);
+    }
+    xmlFreeDoc(doc);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = BenchIterations(argc, argv, 20);
+
+    char dir[] = "/tmp/xlaunch-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    std::vector<double> streaming, dom;
+    try {
+        for (int i = 0; i < FILES; i++)
+        {
+            char name[64], host[64], program[64];
+            snprintf(name, sizeof(name), "%s/config%d.xlaunch", dir, i);
+            snprintf(host, sizeof(host), "host%d.example.org", i % 50);
+            snprintf(program, sizeof(program), "xterm -T session%d", i);
+            CConfig config;
+            config.client = CConfig::StartProgram;
+            config.local = false;
+            config.host = host;
+            config.protocol = "ssh";
+            config.remoteprogram = program;
+            for (int c = 0; c < i % 4; c++)
+                config.clients.push_back(CClientEntry(c % 2, program));
+            config.Save(name);
+            files.push_back(name);
+        }
+
+        for (int n = 0; n < iterations; n++)
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                CConfig config;
+                double start = BenchNow();
+                if (!config.Load(files[i].c_str()))
+                    throw std::runtime_error("Can't load " + files[i]);
+                streaming.push_back(BenchNow() - start);
+
+                CConfig other;
+                start = BenchNow();
+                if (!LoadDom(files[i].c_str(), other))
+                    throw std::runtime_error("Can't parse " + files[i]);
+                dom.push_back(BenchNow() - start);
+
+                if (other.host != config.host || other.clients.size() != config.clients.size())
+                    throw std::runtime_error("Loads of " + files[i] + " differ");
+            }
+    } catch (std::runtime_error &e)
+    {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    std::string command = std::string("rm -rf ") + dir;
+    if (system(command.c_str()) != 0)
+        fprintf(stderr, "Can't remove %s\n", dir);
+
+    BenchHeader("us");
+    BenchReport("Streaming reader", streaming);
+    BenchReport("DOM and xmlGetProp", dom);
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/*
+ * Latency of saving configurations in bulk with CConfig::Save, which
+ * writes the document directly to a new file, flushes it and renames it
+ * over the old one. It is compared with building a DOM and writing it with
+ * xmlSaveFormatFileEnc, as Save did before, both in place and with the
+ * same flush and rename, which shows what the emitter itself saves.
+ *
+ *   tests/save_bench [iterations]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <stdexcept>
+#include <string>
+#include "config.h"
+#include "config_schema.h"
+#include "bench.h"
+
+#define FILES 100
+
+/// @brief Build the document of a configuration.
+static xmlDocPtr Document(const CConfig &config)
+{
+    xmlDocPtr doc = xmlNewDoc(BAD_CAST "1.0");
+    xmlNodePtr root = xmlNewNode(NULL, BAD_CAST "XLaunch");
+    xmlDocSetRootElement(doc, root);
+    for (size_t i = 0; i < config_field_count; i++)
+        xmlNewProp(root, BAD_CAST config_fields[i].name,
+                   BAD_CAST GetConfigField(config, config_fields[i]).c_str());
+    for (size_t i = 0; i < config.clients.size(); i++)
+    {
+        xmlNodePtr client = xmlNewChild(root, NULL, BAD_CAST "Client", NULL);
+        xmlNewProp(client, BAD_CAST "Local", BAD_CAST (config.clients[i].local ? "True" : "False"));
+        xmlNewProp(client, BAD_CAST "Program", BAD_CAST config.clients[i].program.c_str());
+    }
+    return doc;
+}
+
+/// @brief Save through a DOM, in place or replacing the file as Save does.
+static void SaveDom(const CConfig &config, const std::string &filename, bool replace)
+{
+    xmlDocPtr doc = Document(config);
+    std::string target = replace ? filename + ".tmp" : filename;
+    int ret = xmlSaveFormatFileEnc(target.c_str(), doc, "UTF-8", 1);
+    xmlFreeDoc(doc);
+    if (ret < 0)
+        throw std::runtime_error("Can't save " + target);
+    if (!replace)
+        return;
+    int fd = open(target.c_str(), O_WRONLY);
+    bool ok = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0)
+        close(fd);
+    if (!ok || rename(target.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("Can't replace " + filename);
+    // The rename is flushed too
+    fd = open(filename.substr(0, filename.rfind('/')).c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = BenchIterations(argc, argv, 5);
+
+    char dir[] = "/tmp/xlaunch-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    std::vector<CConfig> configs;
+    std::vector<std::string> files;
+    for (int i = 0; i < FILES; i++)
+    {
+        char name[64], host[64], program[64];
+        snprintf(name, sizeof(name), "%s/config%d.xlaunch", dir, i);
+        snprintf(host, sizeof(host), "host%d.example.org", i);
+        snprintf(program, sizeof(program), "xterm -T \"user %d\" -e 'tail -f log'", i);
+        CConfig config;
+        config.client = CConfig::StartProgram;
+        config.local = false;
+        config.host = host;
+        config.protocol = "ssh";
+        config.remoteprogram = program;
+        config.clients.push_back(CClientEntry(true, program));
+        configs.push_back(config);
+        files.push_back(name);
+    }
+
+    std::vector<double> save, dom, domreplace;
+    double total[3] = { 0, 0, 0 };
+    try {
+        for (int n = 0; n < iterations; n++)
+        {
+            double bulk = BenchNow();
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                double start = BenchNow();
+                configs[i].Save(files[i].c_str());
+                save.push_back(BenchNow() - start);
+            }
+            total[0] += BenchNow() - bulk;
+
+            bulk = BenchNow();
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                double start = BenchNow();
+                SaveDom(configs[i], files[i], false);
+                dom.push_back(BenchNow() - start);
+            }
+            total[1] += BenchNow() - bulk;
+
+            bulk = BenchNow();
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                double start = BenchNow();
+                SaveDom(configs[i], files[i], true);
+                domreplace.push_back(BenchNow() - start);
+            }
+            total[2] += BenchNow() - bulk;
+        }
+    } catch (std::runtime_error &e)
+    {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    std::string command = std::string("rm -rf ") + dir;
+    if (system(command.c_str()) != 0)
+        fprintf(stderr, "Can't remove %s\n", dir);
+
+    BenchHeader("us");
+    BenchReport("Save", save);
+    BenchReport("DOM, in place", dom);
+    BenchReport("DOM, flushed and renamed", domreplace);
+    printf("\nFiles saved per second: Save %.0f, DOM in place %.0f, DOM flushed and renamed %.0f\n",
+           save.size() / total[0] * 1e6, dom.size() / total[1] * 1e6,
+           domreplace.size() / total[2] * 1e6);
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/*
+ * Latency of starting a process with Spawn, compared with fork and exec.
+ * "start" is the time until the call returns, "run" until the process,
+ * which exits at once, has been waited for.
+ *
+ *   tests/spawn_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <stdexcept>
+#include "launchspawn.h"
+#include "bench.h"
+
+#define TRUE_PROGRAM "/bin/true"
+
+static void Wait(SpawnedProcess &process)
+{
+#ifdef SPAWN_WIN32
+    WaitForSingleObject(process.hProcess, INFINITE);
+    CloseHandle(process.hProcess);
+    CloseHandle(process.hThread);
+#else
+    int status;
+    waitpid(process, &status, 0);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = BenchIterations(argc, argv, 1000);
+
+    SpawnRequest request;
+    request.show = false;
+    std::string program;
+    if (!FindProgram("true", "/usr/bin:/bin", program))
+    {
+        fprintf(stderr, "true not found\n");
+        return 1;
+    }
+    request.argv.push_back(program);
+
+    std::vector<double> spawn_start, spawn_run, fork_start, fork_run;
+    try {
+        for (int i = 0; i < iterations; i++)
+        {
+            SpawnedProcess process;
+            double start = BenchNow();
+            Spawn(request, process);
+            double started = BenchNow();
+            Wait(process);
+            spawn_start.push_back(started - start);
+            spawn_run.push_back(BenchNow() - start);
+
+            start = BenchNow();
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                execl(TRUE_PROGRAM, TRUE_PROGRAM, (char *)NULL);
+                _exit(127);
+            }
+            started = BenchNow();
+            if (pid < 0)
+                throw std::runtime_error("fork failed");
+            int status;
+            waitpid(pid, &status, 0);
+            fork_start.push_back(started - start);
+            fork_run.push_back(BenchNow() - start);
+        }
+    } catch (std::runtime_error &e)
+    {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    BenchHeader("us");
+    BenchReport("Spawn start", spawn_start);
+    BenchReport("Spawn run", spawn_run);
+    BenchReport("fork+exec start", fork_start);
+    BenchReport("fork+exec run", fork_run);
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#ifdef __CYGWIN__
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <pthread.h>
+#include <time.h>
+#include <stdexcept>
+#include "trace.h"
+
+FILE *CTrace::file = NULL;
+bool CTrace::first = true;
+static struct timespec origin;
+/* Serializes events of the session threads */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// @brief Ids of the process and thread, as other tools show them.
+static void Ids(unsigned long &pid, unsigned long &tid)
+{
+#ifdef __CYGWIN__
+    pid = GetCurrentProcessId();
+    tid = GetCurrentThreadId();
+#else
+    pid = getpid();
+    tid = syscall(SYS_gettid);
+#endif
+}
+
+void CTrace::Open(const char *filename)
+{
+    Close();
+    file = fopen(filename, "w");
+    if (file == NULL)
+        throw std::runtime_error(std::string("Can't open trace file ") + filename);
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+    first = true;
+    fprintf(file, "[");
+}
+
+void CTrace::Close()
+{
+    if (file == NULL)
+        return;
+    pthread_mutex_lock(&lock);
+    fprintf(file, "\n]\n");
+    fclose(file);
+    file = NULL;
+    pthread_mutex_unlock(&lock);
+}
+
+/// @brief Write a string as JSON string contents.
+static void WriteEscaped(FILE *f, const char *s)
+{
+    for (; *s; s++)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+}
+
+void CTrace::Event(const char *name, char phase)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long us = (now.tv_sec - origin.tv_sec) * 1000000LL + (now.tv_nsec - origin.tv_nsec) / 1000;
+    unsigned long pid, tid;
+    Ids(pid, tid);
+
+    pthread_mutex_lock(&lock);
+    if (file == NULL)
+    {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    fprintf(file, "%s\n{\"name\":\"", first ? "" : ",");
+    WriteEscaped(file, name);
+    fprintf(file, "\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":%lu,\"tid\":%lu%s}",
+            phase, us, pid, tid, phase == 'i' ? ",\"s\":\"t\"" : "");
+    first = false;
+    fflush(file);
+    pthread_mutex_unlock(&lock);
+}
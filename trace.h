@@ -0,0 +1,63 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+
+/// @brief Launch timeline in Chrome trace event format.
+/// Events are only recorded after Open() was called, so a disabled trace
+/// costs a single pointer check per event. Events may be recorded from any
+/// thread once the trace is open.
+class CTrace
+{
+    private:
+        static FILE *file;
+        static bool first;
+        static void Event(const char *name, char phase);
+    public:
+        /// @brief Start writing trace events to a file.
+        static void Open(const char *filename);
+        /// @brief Finish the trace and close the file.
+        static void Close();
+        static bool Enabled() { return file != NULL; }
+        /// @brief Record the start of a phase.
+        static void Begin(const char *name) { if (file) Event(name, 'B'); }
+        /// @brief Record the end of a phase started with Begin().
+        static void End(const char *name) { if (file) Event(name, 'E'); }
+        /// @brief Record a point in time.
+        static void Instant(const char *name) { if (file) Event(name, 'i'); }
+};
+
+/// @brief Record a phase for the lifetime of the object.
+class CTraceScope
+{
+    private:
+        const char *name;
+    public:
+        CTraceScope(const char *name) : name(name) { CTrace::Begin(name); }
+        ~CTraceScope() { CTrace::End(name); }
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "validate.h"
+#include "config.h"
+
+/// @brief Files to check and what was found, shared by the workers.
+struct CValidation
+{
+    const std::vector<std::string> *files;
+    std::vector<std::vector<CConfigProblem> > problems;
+    size_t next;            /// Next file to take, taken atomically.
+};
+
+static void *Worker(void *arg)
+{
+    CValidation *work = (CValidation *)arg;
+    for (;;)
+    {
+        size_t i = __sync_fetch_and_add(&work->next, 1);
+        if (i >= work->files->size())
+            break;
+
+        const std::string &file = (*work->files)[i];
+        std::vector<CConfigProblem> &problems = work->problems[i];
+        struct stat st;
+        if (stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            problems.push_back(CConfigProblem("", "can't open file"));
+            continue;
+        }
+        CConfig config;
+        if (config.Load(file.c_str(), &problems))
+            config.Validate(problems);
+    }
+    return NULL;
+}
+
+/// @brief Make a message fit on its line of the report.
+static std::string Field(std::string str)
+{
+    for (size_t i = 0; i < str.size(); i++)
+        if (str[i] == '\t' || str[i] == '\n' || str[i] == '\r')
+            str[i] = ' ';
+    return str;
+}
+
+int ValidateConfigs(const std::vector<std::string> &files, FILE *out)
+{
+    CValidation work;
+    work.files = &files;
+    work.problems.resize(files.size());
+    work.next = 0;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t count = cpus > 0 ? cpus : 1;
+    if (count > files.size())
+        count = files.size();
+    // This thread is one of the workers, so there is progress even if no
+    // other thread could be started
+    std::vector<pthread_t> threads;
+    for (size_t i = 1; i < count; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, Worker, &work) == 0)
+            threads.push_back(thread);
+    }
+    Worker(&work);
+    for (size_t i = 0; i < threads.size(); i++)
+        pthread_join(threads[i], NULL);
+
+    size_t failed = 0, warned = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const std::vector<CConfigProblem> &problems = work.problems[i];
+        size_t warnings = 0;
+        for (size_t p = 0; p < problems.size(); p++)
+            if (problems[p].warning)
+                warnings++;
+        if (warnings == problems.size())
+            fprintf(out, "ok\t%s\n", Field(files[i]).c_str());
+        else
+            failed++;
+        if (warnings)
+            warned++;
+        for (size_t p = 0; p < problems.size(); p++)
+            fprintf(out, "%s\t%s\t%s\t%s\n", problems[p].warning ? "warning" : "error",
+                    Field(files[i]).c_str(), Field(problems[p].field).c_str(),
+                    Field(problems[p].message).c_str());
+    }
+    fflush(out);
+    fprintf(stderr, "%lu files checked, %lu with errors, %lu with warnings\n",
+            (unsigned long)files.size(), (unsigned long)failed, (unsigned long)warned);
+    return failed ? 1 : 0;
+}
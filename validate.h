@@ -0,0 +1,43 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __VALIDATE_H__
+#define __VALIDATE_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/// @brief Check configuration files and print a report.
+/// The files are loaded and checked with CConfig::Validate() on a pool of
+/// threads, one per processor. The report has a line per file which is
+/// fine, "ok<TAB>file", and one per problem found, "error<TAB>file<TAB>
+/// attribute<TAB>message", in the order the files were given. Problems
+/// which don't keep a file from being used, like attributes this version
+/// doesn't know, are reported as "warning" instead of "error" and leave
+/// the file fine.
+/// @param out Where to print the report.
+/// @return 0 if all files are fine, 1 if not.
+int ValidateConfigs(const std::vector<std::string> &files, FILE *out);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include <sys/stat.h>
+#include "watch.h"
+#ifdef __CYGWIN__
+#include <sys/cygwin.h>
+#endif
+
+CFileWatch::CFileWatch(const std::string &filename) :
+    filename(filename), change(NULL), device(0), inode(0), size(0), mtime(0)
+{
+    Stamp(device, inode, size, mtime);
+
+    size_t slash = filename.find_last_of("/\\");
+    std::string dir = slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+#ifdef __CYGWIN__
+    char native[MAX_PATH];
+    if (cygwin_conv_path(CCP_POSIX_TO_WIN_A | CCP_ABSOLUTE, dir.c_str(), native, sizeof(native)) != 0)
+        return;
+    dir = native;
+#endif
+    change = FindFirstChangeNotification(dir.c_str(), FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    if (change == INVALID_HANDLE_VALUE)
+        change = NULL;
+}
+
+CFileWatch::~CFileWatch()
+{
+    if (change)
+        FindCloseChangeNotification(change);
+}
+
+/// @brief Get what identifies the current contents of the file.
+/// @return false if it doesn't exist, eg. halfway through being replaced.
+bool CFileWatch::Stamp(dev_t &device, ino_t &inode, off_t &size, long long &mtime)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+    device = st.st_dev;
+    inode = st.st_ino;
+    size = st.st_size;
+    mtime = (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool CFileWatch::Changed()
+{
+    if (change)
+        FindNextChangeNotification(change);
+
+    dev_t newdevice;
+    ino_t newinode;
+    off_t newsize;
+    long long newmtime;
+    if (!Stamp(newdevice, newinode, newsize, newmtime))
+        return false;
+    if (newdevice == device && newinode == inode && newsize == size && newmtime == mtime)
+        return false;
+    device = newdevice;
+    inode = newinode;
+    size = newsize;
+    mtime = newmtime;
+    return true;
+}
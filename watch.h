@@ -0,0 +1,56 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+#include <windows.h>
+#include <sys/types.h>
+#include <string>
+
+/// @brief Notices when a file is written or replaced.
+/// Watches the directory of the file, so a file replaced by renaming
+/// another over it is still seen, and compares the file with what it was
+/// to ignore changes to anything else in the directory.
+class CFileWatch
+{
+    private:
+        std::string filename;
+        HANDLE change;
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        long long mtime;
+        bool Stamp(dev_t &device, ino_t &inode, off_t &size, long long &mtime);
+    public:
+        CFileWatch(const std::string &filename);
+        ~CFileWatch();
+        /// @brief Handle signalled when something in the directory changed.
+        /// @return NULL if the directory can't be watched.
+        HANDLE Handle() { return change; }
+        /// @brief Wait for the next change, after the handle was signalled.
+        /// @return true if the file is not the same as when last checked.
+        bool Changed();
+};
+
+#endif